@@ -0,0 +1,183 @@
+/*
+ * bench_run - run one command and measure it for bench_xor.sh
+ *
+ * Usage: bench_run [-d FILE]... METRICS -- COMMAND [ARG]...
+ *
+ * Runs COMMAND with the caller's stdin and stdout, then writes one line
+ * to METRICS: wall seconds, CPU seconds, cycles and peak RSS in KB, and
+ * whether the cycles came from the PMU ("pmu") or were estimated from CPU
+ * time and the clock rate ("est"). Each -d FILE is dropped from the page
+ * cache first, for cold-cache runs.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+#define PROG_NAME "bench_run"
+#define MAX_DROPS 16
+
+static void die(const char *msg) {
+    fprintf(stderr, "%s: %s: %s\n", PROG_NAME, msg, strerror(errno));
+    exit(1);
+}
+
+// Write back and evict a file's cached pages; no privileges needed
+static void drop_cache(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        die(path);
+    }
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+}
+
+// Cycles counter for pid and the threads it starts, enabled when it execs
+static int open_cycles(pid_t pid) {
+#ifdef __linux__
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CPU_CYCLES;
+    attr.disabled = 1;
+    attr.enable_on_exec = 1;
+    attr.inherit = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, pid, -1, -1, 0);
+#else
+    (void)pid;
+    return -1;
+#endif
+}
+
+// Nominal clock rate in Hz, for estimating cycles from CPU time
+static double clock_rate(void) {
+    FILE *f = fopen("/sys/devices/system/cpu/cpu0/cpufreq/cpuinfo_max_freq", "r");
+    double khz = 0;
+    if (f != NULL) {
+        if (fscanf(f, "%lf", &khz) != 1) {
+            khz = 0;
+        }
+        fclose(f);
+        if (khz > 0) {
+            return khz * 1e3;
+        }
+    }
+    f = fopen("/proc/cpuinfo", "r");
+    if (f != NULL) {
+        char line[256];
+        double mhz = 0;
+        while (fgets(line, sizeof(line), f) != NULL) {
+            if (strncmp(line, "cpu MHz", 7) == 0 && sscanf(strchr(line, ':') + 1, "%lf", &mhz) == 1) {
+                break;
+            }
+        }
+        fclose(f);
+        if (mhz > 0) {
+            return mhz * 1e6;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    const char *drops[MAX_DROPS];
+    int drop_count = 0;
+    int arg = 1;
+    while (arg + 1 < argc && strcmp(argv[arg], "-d") == 0 && drop_count < MAX_DROPS) {
+        drops[drop_count++] = argv[arg + 1];
+        arg += 2;
+    }
+    if (argc - arg < 3 || strcmp(argv[arg + 1], "--") != 0) {
+        fprintf(stderr, "Usage: %s [-d FILE]... METRICS -- COMMAND [ARG]...\n", PROG_NAME);
+        return 2;
+    }
+    const char *metrics = argv[arg];
+    char **command = argv + arg + 2;
+
+    for (int i = 0; i < drop_count; i++) {
+        drop_cache(drops[i]);
+    }
+
+    // The child waits on the pipe until its counter is attached
+    int go[2];
+    if (pipe(go) != 0) {
+        die("pipe");
+    }
+    struct timespec start, end;
+    pid_t pid = fork();
+    if (pid < 0) {
+        die("fork");
+    }
+    if (pid == 0) {
+        char c;
+        close(go[1]);
+        if (read(go[0], &c, 1) < 0) {
+            _exit(127);
+        }
+        close(go[0]);
+        execvp(command[0], command);
+        fprintf(stderr, "%s: %s: %s\n", PROG_NAME, command[0], strerror(errno));
+        _exit(127);
+    }
+    close(go[0]);
+    int counter = open_cycles(pid);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    close(go[1]);
+
+    int status;
+    struct rusage usage;
+    while (wait4(pid, &status, 0, &usage) < 0) {
+        if (errno != EINTR) {
+            die("wait4");
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double wall = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+    double cpu = (double)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+                 (double)(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+    uint64_t cycles = 0;
+    const char *source = "est";
+    if (counter >= 0 && read(counter, &cycles, sizeof(cycles)) == (ssize_t)sizeof(cycles) && cycles > 0) {
+        source = "pmu";
+    } else {
+        cycles = (uint64_t)(cpu * clock_rate());
+    }
+    if (counter >= 0) {
+        close(counter);
+    }
+
+    FILE *out = fopen(metrics, "w");
+    if (out == NULL) {
+        die(metrics);
+    }
+    // ru_maxrss is in KB on Linux and bytes on macOS
+#ifdef __APPLE__
+    long rss_kb = usage.ru_maxrss / 1024;
+#else
+    long rss_kb = usage.ru_maxrss;
+#endif
+    fprintf(out, "%.6f %.6f %llu %ld %s\n", wall, cpu, (unsigned long long)cycles, rss_kb, source);
+    fclose(out);
+
+    if (WIFEXITED(status)) {
+        return WEXITSTATUS(status);
+    }
+    return 128 + WTERMSIG(status);
+}
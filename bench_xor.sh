@@ -0,0 +1,176 @@
+#!/bin/bash
+set -euo pipefail
+
+# XOR Tool Benchmarks
+# Times ./xor over a matrix of sizes, length ratios and input sources, and
+# writes one tab-separated line per case to bench_output.txt. With a
+# baseline from an earlier run, each case's throughput is compared with it
+# and the run fails if any case got slower by more than the tolerance.
+#
+# Settings, from the environment:
+#   BENCH_SIZES      file sizes to run (default: 4K 1M 64M 512M; up to 16G)
+#   BENCH_RATIOS     file1:file2 length ratios (default: 1:1 2:1 16:1)
+#   BENCH_SOURCES    cached, cold and pipe (default: all three)
+#   BENCH_RUNS       runs per case; the fastest is kept (default: 3)
+#   BENCH_DIR        where the data files go (default: a directory in $TMPDIR)
+#   BENCH_OUTPUT     results file (default: bench_output.txt)
+#   BENCH_BASELINE   earlier results to compare with (default: none)
+#   BENCH_TOLERANCE  allowed slowdown in percent (default: 10)
+
+GREEN='\033[0;32m'
+RED='\033[0;31m'
+YELLOW='\033[1;33m'
+BLUE='\033[1;34m'
+NC='\033[0m'
+
+SIZES=${BENCH_SIZES:-4K 1M 64M 512M}
+RATIOS=${BENCH_RATIOS:-1:1 2:1 16:1}
+SOURCES=${BENCH_SOURCES:-cached cold pipe}
+RUNS=${BENCH_RUNS:-3}
+OUTPUT=${BENCH_OUTPUT:-bench_output.txt}
+BASELINE=${BENCH_BASELINE:-}
+TOLERANCE=${BENCH_TOLERANCE:-10}
+
+XOR=./xor
+RUNNER=./bench_run
+if [ ! -x "$XOR" ] || [ ! -x "$RUNNER" ]; then
+    echo "bench_xor.sh: build first with: make xor bench_run" >&2
+    exit 2
+fi
+
+if [ -n "${BENCH_DIR:-}" ]; then
+    mkdir -p "$BENCH_DIR"
+    DATA_DIR=$BENCH_DIR
+    OWN_DIR=false
+else
+    DATA_DIR=$(mktemp -d "${TMPDIR:-/tmp}/xor-bench.XXXXXX")
+    OWN_DIR=true
+fi
+
+cleanup() {
+    rm -f "$DATA_DIR"/bench_*.dat "$DATA_DIR"/bench_metrics.txt
+    if $OWN_DIR; then
+        rmdir "$DATA_DIR" 2>/dev/null || true
+    fi
+}
+trap cleanup EXIT
+
+# 4K, 64M, 16G and plain byte counts to bytes
+to_bytes() {
+    local size=$1
+    case "$size" in
+        *K) echo $(( ${size%K} * 1024 )) ;;
+        *M) echo $(( ${size%M} * 1024 * 1024 )) ;;
+        *G) echo $(( ${size%G} * 1024 * 1024 * 1024 )) ;;
+        *) echo "$size" ;;
+    esac
+}
+
+# Time one case RUNS times and print its result line
+run_case() {
+    local name=$1 source=$2 file1=$3 file2=$4 bytes=$5
+    local out="$DATA_DIR/bench_out.dat"
+    local metrics="$DATA_DIR/bench_metrics.txt"
+    local best_wall="" best_cycles=0 best_source=est peak_rss=0
+    local wall cpu cycles rss cycles_source
+
+    for ((run = 0; run < RUNS; run++)); do
+        case "$source" in
+            cached)
+                cat "$file1" "$file2" > /dev/null
+                "$RUNNER" "$metrics" -- "$XOR" "$file1" "$file2" > "$out"
+                ;;
+            cold)
+                "$RUNNER" -d "$file1" -d "$file2" "$metrics" -- "$XOR" "$file1" "$file2" > "$out"
+                ;;
+            pipe)
+                cat "$file1" "$file2" > /dev/null
+                cat "$file1" | "$RUNNER" "$metrics" -- "$XOR" - "$file2" > "$out"
+                ;;
+        esac
+        read -r wall cpu cycles rss cycles_source < "$metrics"
+        if [ -z "$best_wall" ] || awk -v a="$wall" -v b="$best_wall" 'BEGIN { exit !(a < b) }'; then
+            best_wall=$wall
+            best_cycles=$cycles
+            best_source=$cycles_source
+        fi
+        if [ "$rss" -gt "$peak_rss" ]; then
+            peak_rss=$rss
+        fi
+    done
+
+    awk -v name="$name" -v bytes="$bytes" -v wall="$best_wall" -v cycles="$best_cycles" \
+        -v rss="$peak_rss" -v src="$best_source" 'BEGIN {
+        if (wall <= 0) wall = 1e-6
+        printf "%s\t%d\t%.6f\t%.3f\t%.3f\t%d\t%s\n", name, bytes, wall, bytes / wall / 1e9, cycles / bytes, rss, src
+    }'
+}
+
+kernel=$("$XOR" -p <(echo a) <(echo b) 2>&1 >/dev/null | sed -n 's/.*(\([a-z0-9]*\) kernel.*/\1/p' || true)
+{
+    echo "# xor benchmark: $("$XOR" --version 2>&1 | head -1)"
+    echo "# host: $(uname -sm), $(getconf _NPROCESSORS_ONLN 2>/dev/null || echo '?') CPUs, ${kernel:-unknown} kernel, $RUNS runs per case"
+    echo -e "# case\tbytes\tseconds\tgb_per_s\tcycles_per_byte\tpeak_rss_kb\tcycles_source"
+} > "$OUTPUT"
+
+echo -e "${BLUE}=== XOR Benchmarks ===${NC}"
+echo "Data in $DATA_DIR, results in $OUTPUT"
+echo
+
+for size in $SIZES; do
+    bytes=$(to_bytes "$size")
+    file1="$DATA_DIR/bench_1.dat"
+    head -c "$bytes" /dev/urandom > "$file1"
+    for ratio in $RATIOS; do
+        # file2 is file1's length divided by the ratio, at least one byte
+        num=${ratio%:*}
+        den=${ratio#*:}
+        len2=$(( bytes * den / num ))
+        [ "$len2" -gt 0 ] || len2=1
+        file2="$DATA_DIR/bench_2.dat"
+        head -c "$len2" /dev/urandom > "$file2"
+        for source in $SOURCES; do
+            name="$source/$size/$ratio"
+            echo -ne "${YELLOW}Running: $name${NC} ... "
+            line=$(run_case "$name" "$source" "$file1" "$file2" "$bytes")
+            echo "$line" >> "$OUTPUT"
+            echo "$line" | awk -F'\t' '{ printf "%s GB/s, %s cycles/byte, %s KB peak RSS\n", $4, $5, $6 }'
+        done
+    done
+    rm -f "$DATA_DIR"/bench_*.dat
+done
+
+if [ -z "$BASELINE" ]; then
+    exit 0
+fi
+if [ ! -f "$BASELINE" ]; then
+    echo "bench_xor.sh: no baseline at $BASELINE" >&2
+    exit 2
+fi
+
+echo
+echo -e "${BLUE}=== Against $BASELINE (tolerance ${TOLERANCE}%) ===${NC}"
+echo
+if awk -F'\t' -v tolerance="$TOLERANCE" -v red="$RED" -v green="$GREEN" -v nc="$NC" '
+    /^#/ { next }
+    FNR == NR { base[$1] = $4; next }
+    ($1 in base) && base[$1] > 0 {
+        change = ($4 - base[$1]) / base[$1] * 100
+        mark = ""
+        if (change < -tolerance) {
+            mark = red "  REGRESSION" nc
+            slower++
+        } else if (change > tolerance) {
+            mark = green "  faster" nc
+        }
+        printf "%-24s %9.3f -> %9.3f GB/s  %+7.1f%%%s\n", $1, base[$1], $4, change, mark
+    }
+    END { exit slower > 0 }
+' "$BASELINE" "$OUTPUT"; then
+    echo
+    echo -e "${GREEN}No case slower than the baseline by more than ${TOLERANCE}%${NC}"
+else
+    echo
+    echo -e "${RED}Some cases are slower than the baseline${NC}"
+    exit 1
+fi
@@ -0,0 +1,1043 @@
+/*
+ * libxor - the XOR engine behind the xor tool
+ *
+ * Kernels, keys and the streaming context declared in xor.h. Nothing here
+ * does I/O or exits; errors come back as XOR_ERR_* codes, and only a
+ * documented precondition is asserted.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "xor.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define XOR_X86 1
+#include <immintrin.h>
+#else
+#define XOR_X86 0
+#endif
+
+#define GF_POLY 0x11d           // GF(2^8) reduction polynomial
+#define KEY_SPAN 65536          // Most key bytes applied from one offset
+#define MULTI_MAX 256           // Most sources one multi kernel call takes
+
+// A runtime-selectable XOR kernel, returning the length of the output up
+// to its last nonzero byte
+typedef size_t (*xor_fn)(unsigned char *dst, const unsigned char *a,
+                       const unsigned char *b, size_t n);
+
+// The same, XORing a with a 64-byte pattern repeated across it
+typedef size_t (*xor_repeat_fn)(unsigned char *dst, const unsigned char *a,
+                                const unsigned char *pattern, size_t n);
+
+// The same, XORing count >= 1 sources together in one pass
+typedef size_t (*xor_multi_fn)(unsigned char *dst, const unsigned char *const *src,
+                               size_t count, size_t n);
+
+typedef struct {
+    const char *name;
+    xor_fn fn;
+    xor_repeat_fn repeat;
+    xor_multi_fn multi;
+    bool (*supported)(void);
+} xor_kernel;
+
+// A GF(2^8) multiply-accumulate kernel: dst ^= c * src, where tables holds
+// c times each low nibble, then c times each high nibble
+typedef void (*gf_mul_fn)(unsigned char *dst, const unsigned char *src,
+                          const unsigned char *tables, size_t n);
+
+typedef struct {
+    const char *name;
+    gf_mul_fn fn;
+    bool (*supported)(void);
+} gf_kernel;
+
+// A ChaCha20 kernel writing blocks 64-byte keystream blocks, starting at
+// block, from the seed state. blocks is a multiple of the kernel's batch.
+typedef void (*keystream_fn)(const uint32_t *state, uint64_t block, unsigned char *out,
+                             size_t blocks);
+
+typedef struct {
+    const char *name;
+    keystream_fn fn;
+    size_t batch;
+    bool (*supported)(void);
+} keystream_kernel;
+
+// The kernels in use, chosen together
+typedef struct {
+    const xor_kernel *xor;
+    const gf_kernel *gf;
+    const keystream_kernel *chacha;
+} kernel_set;
+
+static kernel_set kernels;
+static pthread_once_t kernels_once = PTHREAD_ONCE_INIT;
+
+static const kernel_set *active(void);
+
+static const unsigned char zero_span[KEY_SPAN];
+
+// XOR kernels. Each computes dst[i] = a[i] ^ b[i] for n bytes and returns
+// the length of dst up to and including its last nonzero byte (0 if it is
+// all zeros), so trailing zeros can be stripped without a second pass.
+// dst may alias either input. The widest one the CPU supports is picked at
+// startup.
+
+// Step back over the zeros at the end of dst[0, end). The kernels call this
+// once, with end already at most one vector past the last nonzero byte.
+static size_t trim_zeros(const unsigned char *dst, size_t end) {
+    while (end > 0 && dst[end - 1] == 0) {
+        end--;
+    }
+    return end;
+}
+
+static size_t xor_kernel_scalar(unsigned char *dst, const unsigned char *a,
+                                const unsigned char *b, size_t n) {
+    size_t i = 0;
+    size_t end = 0;
+    for (; i + sizeof(uint64_t) <= n; i += sizeof(uint64_t)) {
+        uint64_t x, y;
+        memcpy(&x, a + i, sizeof(x));
+        memcpy(&y, b + i, sizeof(y));
+        x ^= y;
+        memcpy(dst + i, &x, sizeof(x));
+        end = x ? i + sizeof(x) : end;
+    }
+    for (; i < n; i++) {
+        dst[i] = a[i] ^ b[i];
+        end = dst[i] ? i + 1 : end;
+    }
+    return trim_zeros(dst, end);
+}
+
+static size_t xor_repeat_scalar(unsigned char *dst, const unsigned char *a,
+                                const unsigned char *pattern, size_t n) {
+    uint64_t key[64 / sizeof(uint64_t)];
+    memcpy(key, pattern, sizeof(key));
+    size_t i = 0;
+    size_t end = 0;
+    for (; i + sizeof(uint64_t) <= n; i += sizeof(uint64_t)) {
+        uint64_t x;
+        memcpy(&x, a + i, sizeof(x));
+        x ^= key[(i / sizeof(uint64_t)) & 7];
+        memcpy(dst + i, &x, sizeof(x));
+        end = x ? i + sizeof(x) : end;
+    }
+    for (; i < n; i++) {
+        dst[i] = a[i] ^ pattern[i & 63];
+        end = dst[i] ? i + 1 : end;
+    }
+    return trim_zeros(dst, end);
+}
+
+static size_t xor_multi_scalar(unsigned char *dst, const unsigned char *const *src,
+                               size_t count, size_t n) {
+    size_t i = 0;
+    size_t end = 0;
+    for (; i + sizeof(uint64_t) <= n; i += sizeof(uint64_t)) {
+        uint64_t x, y;
+        memcpy(&x, src[0] + i, sizeof(x));
+        for (size_t k = 1; k < count; k++) {
+            memcpy(&y, src[k] + i, sizeof(y));
+            x ^= y;
+        }
+        memcpy(dst + i, &x, sizeof(x));
+        end = x ? i + sizeof(x) : end;
+    }
+    for (; i < n; i++) {
+        unsigned char x = src[0][i];
+        for (size_t k = 1; k < count; k++) {
+            x ^= src[k][i];
+        }
+        dst[i] = x;
+        end = x ? i + 1 : end;
+    }
+    return trim_zeros(dst, end);
+}
+
+// Offset every source pointer by i for the scalar tail of a SIMD kernel
+static size_t xor_multi_tail(unsigned char *dst, const unsigned char *const *src,
+                             size_t count, size_t i, size_t n) {
+    const unsigned char *tail_src[MULTI_MAX];
+    for (size_t k = 0; k < count; k++) {
+        tail_src[k] = src[k] + i;
+    }
+    return xor_multi_scalar(dst + i, tail_src, count, n - i);
+}
+
+#if XOR_X86
+__attribute__((target("sse2")))
+static size_t xor_kernel_sse2(unsigned char *dst, const unsigned char *a,
+                              const unsigned char *b, size_t n) {
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    size_t end = 0;
+    for (; i + 64 <= n; i += 64) {
+        __m128i x0 = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i x1 = _mm_loadu_si128((const __m128i *)(a + i + 16));
+        __m128i x2 = _mm_loadu_si128((const __m128i *)(a + i + 32));
+        __m128i x3 = _mm_loadu_si128((const __m128i *)(a + i + 48));
+        x0 = _mm_xor_si128(x0, _mm_loadu_si128((const __m128i *)(b + i)));
+        x1 = _mm_xor_si128(x1, _mm_loadu_si128((const __m128i *)(b + i + 16)));
+        x2 = _mm_xor_si128(x2, _mm_loadu_si128((const __m128i *)(b + i + 32)));
+        x3 = _mm_xor_si128(x3, _mm_loadu_si128((const __m128i *)(b + i + 48)));
+        _mm_storeu_si128((__m128i *)(dst + i), x0);
+        _mm_storeu_si128((__m128i *)(dst + i + 16), x1);
+        _mm_storeu_si128((__m128i *)(dst + i + 32), x2);
+        _mm_storeu_si128((__m128i *)(dst + i + 48), x3);
+        __m128i any = _mm_or_si128(_mm_or_si128(x0, x1), _mm_or_si128(x2, x3));
+        end = _mm_movemask_epi8(_mm_cmpeq_epi8(any, zero)) != 0xFFFF ? i + 64 : end;
+    }
+    for (; i + 16 <= n; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+        x = _mm_xor_si128(x, _mm_loadu_si128((const __m128i *)(b + i)));
+        _mm_storeu_si128((__m128i *)(dst + i), x);
+        end = _mm_movemask_epi8(_mm_cmpeq_epi8(x, zero)) != 0xFFFF ? i + 16 : end;
+    }
+    size_t tail = xor_kernel_scalar(dst + i, a + i, b + i, n - i);
+    return tail > 0 ? i + tail : trim_zeros(dst, end);
+}
+
+__attribute__((target("avx2")))
+static size_t xor_kernel_avx2(unsigned char *dst, const unsigned char *a,
+                              const unsigned char *b, size_t n) {
+    size_t i = 0;
+    size_t end = 0;
+    for (; i + 128 <= n; i += 128) {
+        __m256i x0 = _mm256_loadu_si256((const __m256i *)(a + i));
+        __m256i x1 = _mm256_loadu_si256((const __m256i *)(a + i + 32));
+        __m256i x2 = _mm256_loadu_si256((const __m256i *)(a + i + 64));
+        __m256i x3 = _mm256_loadu_si256((const __m256i *)(a + i + 96));
+        x0 = _mm256_xor_si256(x0, _mm256_loadu_si256((const __m256i *)(b + i)));
+        x1 = _mm256_xor_si256(x1, _mm256_loadu_si256((const __m256i *)(b + i + 32)));
+        x2 = _mm256_xor_si256(x2, _mm256_loadu_si256((const __m256i *)(b + i + 64)));
+        x3 = _mm256_xor_si256(x3, _mm256_loadu_si256((const __m256i *)(b + i + 96)));
+        _mm256_storeu_si256((__m256i *)(dst + i), x0);
+        _mm256_storeu_si256((__m256i *)(dst + i + 32), x1);
+        _mm256_storeu_si256((__m256i *)(dst + i + 64), x2);
+        _mm256_storeu_si256((__m256i *)(dst + i + 96), x3);
+        __m256i any = _mm256_or_si256(_mm256_or_si256(x0, x1), _mm256_or_si256(x2, x3));
+        end = !_mm256_testz_si256(any, any) ? i + 128 : end;
+    }
+    for (; i + 32 <= n; i += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+        x = _mm256_xor_si256(x, _mm256_loadu_si256((const __m256i *)(b + i)));
+        _mm256_storeu_si256((__m256i *)(dst + i), x);
+        end = !_mm256_testz_si256(x, x) ? i + 32 : end;
+    }
+    size_t tail = xor_kernel_scalar(dst + i, a + i, b + i, n - i);
+    return tail > 0 ? i + tail : trim_zeros(dst, end);
+}
+
+__attribute__((target("avx512f")))
+static size_t xor_kernel_avx512(unsigned char *dst, const unsigned char *a,
+                                const unsigned char *b, size_t n) {
+    size_t i = 0;
+    size_t end = 0;
+    for (; i + 256 <= n; i += 256) {
+        __m512i x0 = _mm512_loadu_si512((const void *)(a + i));
+        __m512i x1 = _mm512_loadu_si512((const void *)(a + i + 64));
+        __m512i x2 = _mm512_loadu_si512((const void *)(a + i + 128));
+        __m512i x3 = _mm512_loadu_si512((const void *)(a + i + 192));
+        x0 = _mm512_xor_si512(x0, _mm512_loadu_si512((const void *)(b + i)));
+        x1 = _mm512_xor_si512(x1, _mm512_loadu_si512((const void *)(b + i + 64)));
+        x2 = _mm512_xor_si512(x2, _mm512_loadu_si512((const void *)(b + i + 128)));
+        x3 = _mm512_xor_si512(x3, _mm512_loadu_si512((const void *)(b + i + 192)));
+        _mm512_storeu_si512((void *)(dst + i), x0);
+        _mm512_storeu_si512((void *)(dst + i + 64), x1);
+        _mm512_storeu_si512((void *)(dst + i + 128), x2);
+        _mm512_storeu_si512((void *)(dst + i + 192), x3);
+        __m512i any = _mm512_or_si512(_mm512_or_si512(x0, x1), _mm512_or_si512(x2, x3));
+        end = _mm512_test_epi64_mask(any, any) ? i + 256 : end;
+    }
+    for (; i + 64 <= n; i += 64) {
+        __m512i x = _mm512_loadu_si512((const void *)(a + i));
+        x = _mm512_xor_si512(x, _mm512_loadu_si512((const void *)(b + i)));
+        _mm512_storeu_si512((void *)(dst + i), x);
+        end = _mm512_test_epi64_mask(x, x) ? i + 64 : end;
+    }
+    size_t tail = xor_kernel_scalar(dst + i, a + i, b + i, n - i);
+    return tail > 0 ? i + tail : trim_zeros(dst, end);
+}
+
+__attribute__((target("sse2")))
+static size_t xor_repeat_sse2(unsigned char *dst, const unsigned char *a,
+                              const unsigned char *pattern, size_t n) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i p0 = _mm_loadu_si128((const __m128i *)pattern);
+    const __m128i p1 = _mm_loadu_si128((const __m128i *)(pattern + 16));
+    const __m128i p2 = _mm_loadu_si128((const __m128i *)(pattern + 32));
+    const __m128i p3 = _mm_loadu_si128((const __m128i *)(pattern + 48));
+    size_t i = 0;
+    size_t end = 0;
+    for (; i + 64 <= n; i += 64) {
+        __m128i x0 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(a + i)), p0);
+        __m128i x1 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(a + i + 16)), p1);
+        __m128i x2 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(a + i + 32)), p2);
+        __m128i x3 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(a + i + 48)), p3);
+        _mm_storeu_si128((__m128i *)(dst + i), x0);
+        _mm_storeu_si128((__m128i *)(dst + i + 16), x1);
+        _mm_storeu_si128((__m128i *)(dst + i + 32), x2);
+        _mm_storeu_si128((__m128i *)(dst + i + 48), x3);
+        __m128i any = _mm_or_si128(_mm_or_si128(x0, x1), _mm_or_si128(x2, x3));
+        end = _mm_movemask_epi8(_mm_cmpeq_epi8(any, zero)) != 0xFFFF ? i + 64 : end;
+    }
+    size_t tail = xor_repeat_scalar(dst + i, a + i, pattern, n - i);
+    return tail > 0 ? i + tail : trim_zeros(dst, end);
+}
+
+__attribute__((target("avx2")))
+static size_t xor_repeat_avx2(unsigned char *dst, const unsigned char *a,
+                              const unsigned char *pattern, size_t n) {
+    const __m256i p0 = _mm256_loadu_si256((const __m256i *)pattern);
+    const __m256i p1 = _mm256_loadu_si256((const __m256i *)(pattern + 32));
+    size_t i = 0;
+    size_t end = 0;
+    for (; i + 128 <= n; i += 128) {
+        __m256i x0 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(a + i)), p0);
+        __m256i x1 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(a + i + 32)), p1);
+        __m256i x2 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(a + i + 64)), p0);
+        __m256i x3 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(a + i + 96)), p1);
+        _mm256_storeu_si256((__m256i *)(dst + i), x0);
+        _mm256_storeu_si256((__m256i *)(dst + i + 32), x1);
+        _mm256_storeu_si256((__m256i *)(dst + i + 64), x2);
+        _mm256_storeu_si256((__m256i *)(dst + i + 96), x3);
+        __m256i any = _mm256_or_si256(_mm256_or_si256(x0, x1), _mm256_or_si256(x2, x3));
+        end = !_mm256_testz_si256(any, any) ? i + 128 : end;
+    }
+    for (; i + 64 <= n; i += 64) {
+        __m256i x0 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(a + i)), p0);
+        __m256i x1 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(a + i + 32)), p1);
+        _mm256_storeu_si256((__m256i *)(dst + i), x0);
+        _mm256_storeu_si256((__m256i *)(dst + i + 32), x1);
+        __m256i any = _mm256_or_si256(x0, x1);
+        end = !_mm256_testz_si256(any, any) ? i + 64 : end;
+    }
+    size_t tail = xor_repeat_scalar(dst + i, a + i, pattern, n - i);
+    return tail > 0 ? i + tail : trim_zeros(dst, end);
+}
+
+__attribute__((target("avx512f")))
+static size_t xor_repeat_avx512(unsigned char *dst, const unsigned char *a,
+                                const unsigned char *pattern, size_t n) {
+    const __m512i p = _mm512_loadu_si512((const void *)pattern);
+    size_t i = 0;
+    size_t end = 0;
+    for (; i + 256 <= n; i += 256) {
+        __m512i x0 = _mm512_xor_si512(_mm512_loadu_si512((const void *)(a + i)), p);
+        __m512i x1 = _mm512_xor_si512(_mm512_loadu_si512((const void *)(a + i + 64)), p);
+        __m512i x2 = _mm512_xor_si512(_mm512_loadu_si512((const void *)(a + i + 128)), p);
+        __m512i x3 = _mm512_xor_si512(_mm512_loadu_si512((const void *)(a + i + 192)), p);
+        _mm512_storeu_si512((void *)(dst + i), x0);
+        _mm512_storeu_si512((void *)(dst + i + 64), x1);
+        _mm512_storeu_si512((void *)(dst + i + 128), x2);
+        _mm512_storeu_si512((void *)(dst + i + 192), x3);
+        __m512i any = _mm512_or_si512(_mm512_or_si512(x0, x1), _mm512_or_si512(x2, x3));
+        end = _mm512_test_epi64_mask(any, any) ? i + 256 : end;
+    }
+    for (; i + 64 <= n; i += 64) {
+        __m512i x = _mm512_xor_si512(_mm512_loadu_si512((const void *)(a + i)), p);
+        _mm512_storeu_si512((void *)(dst + i), x);
+        end = _mm512_test_epi64_mask(x, x) ? i + 64 : end;
+    }
+    size_t tail = xor_repeat_scalar(dst + i, a + i, pattern, n - i);
+    return tail > 0 ? i + tail : trim_zeros(dst, end);
+}
+
+__attribute__((target("sse2")))
+static size_t xor_multi_sse2(unsigned char *dst, const unsigned char *const *src,
+                             size_t count, size_t n) {
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    size_t end = 0;
+    for (; i + 64 <= n; i += 64) {
+        __m128i x0 = _mm_loadu_si128((const __m128i *)(src[0] + i));
+        __m128i x1 = _mm_loadu_si128((const __m128i *)(src[0] + i + 16));
+        __m128i x2 = _mm_loadu_si128((const __m128i *)(src[0] + i + 32));
+        __m128i x3 = _mm_loadu_si128((const __m128i *)(src[0] + i + 48));
+        for (size_t k = 1; k < count; k++) {
+            x0 = _mm_xor_si128(x0, _mm_loadu_si128((const __m128i *)(src[k] + i)));
+            x1 = _mm_xor_si128(x1, _mm_loadu_si128((const __m128i *)(src[k] + i + 16)));
+            x2 = _mm_xor_si128(x2, _mm_loadu_si128((const __m128i *)(src[k] + i + 32)));
+            x3 = _mm_xor_si128(x3, _mm_loadu_si128((const __m128i *)(src[k] + i + 48)));
+        }
+        _mm_storeu_si128((__m128i *)(dst + i), x0);
+        _mm_storeu_si128((__m128i *)(dst + i + 16), x1);
+        _mm_storeu_si128((__m128i *)(dst + i + 32), x2);
+        _mm_storeu_si128((__m128i *)(dst + i + 48), x3);
+        __m128i any = _mm_or_si128(_mm_or_si128(x0, x1), _mm_or_si128(x2, x3));
+        end = _mm_movemask_epi8(_mm_cmpeq_epi8(any, zero)) != 0xFFFF ? i + 64 : end;
+    }
+    size_t tail = xor_multi_tail(dst, src, count, i, n);
+    return tail > 0 ? i + tail : trim_zeros(dst, end);
+}
+
+__attribute__((target("avx2")))
+static size_t xor_multi_avx2(unsigned char *dst, const unsigned char *const *src,
+                             size_t count, size_t n) {
+    size_t i = 0;
+    size_t end = 0;
+    for (; i + 128 <= n; i += 128) {
+        __m256i x0 = _mm256_loadu_si256((const __m256i *)(src[0] + i));
+        __m256i x1 = _mm256_loadu_si256((const __m256i *)(src[0] + i + 32));
+        __m256i x2 = _mm256_loadu_si256((const __m256i *)(src[0] + i + 64));
+        __m256i x3 = _mm256_loadu_si256((const __m256i *)(src[0] + i + 96));
+        for (size_t k = 1; k < count; k++) {
+            x0 = _mm256_xor_si256(x0, _mm256_loadu_si256((const __m256i *)(src[k] + i)));
+            x1 = _mm256_xor_si256(x1, _mm256_loadu_si256((const __m256i *)(src[k] + i + 32)));
+            x2 = _mm256_xor_si256(x2, _mm256_loadu_si256((const __m256i *)(src[k] + i + 64)));
+            x3 = _mm256_xor_si256(x3, _mm256_loadu_si256((const __m256i *)(src[k] + i + 96)));
+        }
+        _mm256_storeu_si256((__m256i *)(dst + i), x0);
+        _mm256_storeu_si256((__m256i *)(dst + i + 32), x1);
+        _mm256_storeu_si256((__m256i *)(dst + i + 64), x2);
+        _mm256_storeu_si256((__m256i *)(dst + i + 96), x3);
+        __m256i any = _mm256_or_si256(_mm256_or_si256(x0, x1), _mm256_or_si256(x2, x3));
+        end = !_mm256_testz_si256(any, any) ? i + 128 : end;
+    }
+    size_t tail = xor_multi_tail(dst, src, count, i, n);
+    return tail > 0 ? i + tail : trim_zeros(dst, end);
+}
+
+__attribute__((target("avx512f")))
+static size_t xor_multi_avx512(unsigned char *dst, const unsigned char *const *src,
+                               size_t count, size_t n) {
+    size_t i = 0;
+    size_t end = 0;
+    for (; i + 256 <= n; i += 256) {
+        __m512i x0 = _mm512_loadu_si512((const void *)(src[0] + i));
+        __m512i x1 = _mm512_loadu_si512((const void *)(src[0] + i + 64));
+        __m512i x2 = _mm512_loadu_si512((const void *)(src[0] + i + 128));
+        __m512i x3 = _mm512_loadu_si512((const void *)(src[0] + i + 192));
+        for (size_t k = 1; k < count; k++) {
+            x0 = _mm512_xor_si512(x0, _mm512_loadu_si512((const void *)(src[k] + i)));
+            x1 = _mm512_xor_si512(x1, _mm512_loadu_si512((const void *)(src[k] + i + 64)));
+            x2 = _mm512_xor_si512(x2, _mm512_loadu_si512((const void *)(src[k] + i + 128)));
+            x3 = _mm512_xor_si512(x3, _mm512_loadu_si512((const void *)(src[k] + i + 192)));
+        }
+        _mm512_storeu_si512((void *)(dst + i), x0);
+        _mm512_storeu_si512((void *)(dst + i + 64), x1);
+        _mm512_storeu_si512((void *)(dst + i + 128), x2);
+        _mm512_storeu_si512((void *)(dst + i + 192), x3);
+        __m512i any = _mm512_or_si512(_mm512_or_si512(x0, x1), _mm512_or_si512(x2, x3));
+        end = _mm512_test_epi64_mask(any, any) ? i + 256 : end;
+    }
+    size_t tail = xor_multi_tail(dst, src, count, i, n);
+    return tail > 0 ? i + tail : trim_zeros(dst, end);
+}
+
+static bool cpu_has_sse2(void) { return __builtin_cpu_supports("sse2"); }
+static bool cpu_has_avx2(void) { return __builtin_cpu_supports("avx2"); }
+static bool cpu_has_avx512(void) { return __builtin_cpu_supports("avx512f"); }
+#endif
+
+// GF(2^8) multiply-accumulate for Reed-Solomon parity. A product c * b is
+// c * (b & 15) ^ c * (b >> 4 << 4), so two 16-entry tables cover every
+// byte, and the SIMD kernels look up a whole register of nibbles at once
+// with a byte shuffle.
+static void gf_mul_add_scalar(unsigned char *dst, const unsigned char *src,
+                              const unsigned char *tables, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        dst[i] ^= tables[src[i] & 15] ^ tables[16 + (src[i] >> 4)];
+    }
+}
+
+#if XOR_X86
+__attribute__((target("ssse3")))
+static void gf_mul_add_ssse3(unsigned char *dst, const unsigned char *src,
+                             const unsigned char *tables, size_t n) {
+    const __m128i lo = _mm_loadu_si128((const __m128i *)tables);
+    const __m128i hi = _mm_loadu_si128((const __m128i *)(tables + 16));
+    const __m128i mask = _mm_set1_epi8(0x0f);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i l = _mm_shuffle_epi8(lo, _mm_and_si128(s, mask));
+        __m128i h = _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi64(s, 4), mask));
+        __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(d, _mm_xor_si128(l, h)));
+    }
+    gf_mul_add_scalar(dst + i, src + i, tables, n - i);
+}
+
+__attribute__((target("avx2")))
+static void gf_mul_add_avx2(unsigned char *dst, const unsigned char *src,
+                            const unsigned char *tables, size_t n) {
+    const __m256i lo = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)tables));
+    const __m256i hi = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(tables + 16)));
+    const __m256i mask = _mm256_set1_epi8(0x0f);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i s = _mm256_loadu_si256((const __m256i *)(src + i));
+        __m256i l = _mm256_shuffle_epi8(lo, _mm256_and_si256(s, mask));
+        __m256i h = _mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi64(s, 4), mask));
+        __m256i d = _mm256_loadu_si256((const __m256i *)(dst + i));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_xor_si256(d, _mm256_xor_si256(l, h)));
+    }
+    gf_mul_add_scalar(dst + i, src + i, tables, n - i);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void gf_mul_add_avx512(unsigned char *dst, const unsigned char *src,
+                              const unsigned char *tables, size_t n) {
+    const __m512i lo = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *)tables));
+    const __m512i hi = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *)(tables + 16)));
+    const __m512i mask = _mm512_set1_epi8(0x0f);
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64) {
+        __m512i s = _mm512_loadu_si512((const void *)(src + i));
+        __m512i l = _mm512_shuffle_epi8(lo, _mm512_and_si512(s, mask));
+        __m512i h = _mm512_shuffle_epi8(hi, _mm512_and_si512(_mm512_srli_epi64(s, 4), mask));
+        __m512i d = _mm512_loadu_si512((const void *)(dst + i));
+        _mm512_storeu_si512((void *)(dst + i), _mm512_ternarylogic_epi64(d, l, h, 0x96));
+    }
+    gf_mul_add_scalar(dst + i, src + i, tables, n - i);
+}
+
+static bool cpu_has_ssse3(void) { return __builtin_cpu_supports("ssse3"); }
+static bool cpu_has_avx512bw(void) {
+    return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+}
+#endif
+
+// ChaCha20 keystream blocks (RFC 7539). Block b is the block function of
+// the seed state with the 64-bit counter in words 12 and 13 advanced by b,
+// which matches the RFC's 32-bit counter and 96-bit nonce for the first
+// 2^32 blocks and then carries instead of repeating.
+#define CHACHA_ROTL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+#define CHACHA_QUARTER(a, b, c, d) \
+    a += b; d ^= a; d = CHACHA_ROTL(d, 16); \
+    c += d; b ^= c; b = CHACHA_ROTL(b, 12); \
+    a += b; d ^= a; d = CHACHA_ROTL(d, 8); \
+    c += d; b ^= c; b = CHACHA_ROTL(b, 7)
+#define CHACHA_DOUBLE_ROUND(x) \
+    CHACHA_QUARTER(x[0], x[4], x[8], x[12]); \
+    CHACHA_QUARTER(x[1], x[5], x[9], x[13]); \
+    CHACHA_QUARTER(x[2], x[6], x[10], x[14]); \
+    CHACHA_QUARTER(x[3], x[7], x[11], x[15]); \
+    CHACHA_QUARTER(x[0], x[5], x[10], x[15]); \
+    CHACHA_QUARTER(x[1], x[6], x[11], x[12]); \
+    CHACHA_QUARTER(x[2], x[7], x[8], x[13]); \
+    CHACHA_QUARTER(x[3], x[4], x[9], x[14])
+
+static void store_le32(unsigned char *p, uint32_t value) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    value = __builtin_bswap32(value);
+#endif
+    memcpy(p, &value, 4);
+}
+
+static void chacha_blocks_scalar(const uint32_t *state, uint64_t block, unsigned char *out,
+                                 size_t blocks) {
+    uint64_t base = ((uint64_t)state[13] << 32 | state[12]) + block;
+    for (size_t b = 0; b < blocks; b++) {
+        uint32_t in[16];
+        uint32_t x[16];
+        memcpy(in, state, sizeof(in));
+        in[12] = (uint32_t)(base + b);
+        in[13] = (uint32_t)((base + b) >> 32);
+        memcpy(x, in, sizeof(x));
+        for (int r = 0; r < 10; r++) {
+            CHACHA_DOUBLE_ROUND(x);
+        }
+        for (int i = 0; i < 16; i++) {
+            store_le32(out + 64 * b + 4 * i, x[i] + in[i]);
+        }
+    }
+}
+
+#if XOR_X86
+// Sixteen blocks at once, one per lane of a 16 x 32-bit vector. The body
+// is written with GCC vector extensions and inlined into each target
+// below, so it compiles to one zmm, two ymm or four xmm registers per
+// state word. AVX-512 transposes the result with two-source permutes; the
+// narrower targets, which lack them, store it lane by lane.
+typedef uint32_t chacha_vec __attribute__((vector_size(64)));
+
+// Shuffles that swap the off-diagonal s x s blocks of each 2s x 2s block
+// of a 16 x 16 matrix, for s = 8, 4, 2 and 1 in turn, which transposes it
+static const chacha_vec chacha_transpose[8] = {
+    {0, 1, 2, 3, 4, 5, 6, 7, 16, 17, 18, 19, 20, 21, 22, 23},
+    {8, 9, 10, 11, 12, 13, 14, 15, 24, 25, 26, 27, 28, 29, 30, 31},
+    {0, 1, 2, 3, 16, 17, 18, 19, 8, 9, 10, 11, 24, 25, 26, 27},
+    {4, 5, 6, 7, 20, 21, 22, 23, 12, 13, 14, 15, 28, 29, 30, 31},
+    {0, 1, 16, 17, 4, 5, 20, 21, 8, 9, 24, 25, 12, 13, 28, 29},
+    {2, 3, 18, 19, 6, 7, 22, 23, 10, 11, 26, 27, 14, 15, 30, 31},
+    {0, 16, 2, 18, 4, 20, 6, 22, 8, 24, 10, 26, 12, 28, 14, 30},
+    {1, 17, 3, 19, 5, 21, 7, 23, 9, 25, 11, 27, 13, 29, 15, 31},
+};
+
+static inline __attribute__((always_inline))
+void chacha_blocks16(const uint32_t *state, uint64_t block, unsigned char *out, size_t blocks,
+                     bool shuffle) {
+    const chacha_vec lanes = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+    uint64_t base = ((uint64_t)state[13] << 32 | state[12]) + block;
+    for (size_t done = 0; done < blocks; done += 16, base += 16) {
+        chacha_vec in[16];
+        chacha_vec x[16];
+        for (int i = 0; i < 16; i++) {
+            in[i] = (chacha_vec){0} + state[i];
+        }
+        in[12] = lanes + (uint32_t)base;
+        in[13] = (chacha_vec){0} + (uint32_t)(base >> 32) - (chacha_vec)(in[12] < lanes);
+        for (int i = 0; i < 16; i++) {
+            x[i] = in[i];
+        }
+        for (int r = 0; r < 10; r++) {
+            CHACHA_DOUBLE_ROUND(x);
+        }
+        for (int i = 0; i < 16; i++) {
+            x[i] += in[i];
+        }
+        unsigned char *dst = out + 64 * done;
+        if (shuffle) {
+            // Transpose so that x[b] holds block b
+            for (int stage = 0; stage < 4; stage++) {
+                int s = 8 >> stage;
+                for (int i = 0; i < 16; i++) {
+                    if (!(i & s)) {
+                        chacha_vec a = x[i];
+                        x[i] = __builtin_shuffle(a, x[i + s], chacha_transpose[2 * stage]);
+                        x[i + s] = __builtin_shuffle(a, x[i + s], chacha_transpose[2 * stage + 1]);
+                    }
+                }
+            }
+            for (int b = 0; b < 16; b++) {
+                for (int i = 0; i < 16; i++) {
+                    store_le32(dst + 64 * b + 4 * i, x[b][i]);
+                }
+            }
+        } else {
+            for (int b = 0; b < 16; b++) {
+                for (int i = 0; i < 16; i++) {
+                    store_le32(dst + 64 * b + 4 * i, x[i][b]);
+                }
+            }
+        }
+    }
+}
+
+__attribute__((target("sse2")))
+static void chacha_blocks_sse2(const uint32_t *state, uint64_t block, unsigned char *out,
+                               size_t blocks) {
+    chacha_blocks16(state, block, out, blocks, false);
+}
+
+__attribute__((target("avx2")))
+static void chacha_blocks_avx2(const uint32_t *state, uint64_t block, unsigned char *out,
+                               size_t blocks) {
+    chacha_blocks16(state, block, out, blocks, false);
+}
+
+__attribute__((target("avx512f")))
+static void chacha_blocks_avx512(const uint32_t *state, uint64_t block, unsigned char *out,
+                                 size_t blocks) {
+    chacha_blocks16(state, block, out, blocks, true);
+}
+#endif
+
+static bool cpu_always(void) { return true; }
+
+// Ordered from most to least preferred
+static const xor_kernel xor_kernels[] = {
+#if XOR_X86
+    {"avx512", xor_kernel_avx512, xor_repeat_avx512, xor_multi_avx512, cpu_has_avx512},
+    {"avx2", xor_kernel_avx2, xor_repeat_avx2, xor_multi_avx2, cpu_has_avx2},
+    {"sse2", xor_kernel_sse2, xor_repeat_sse2, xor_multi_sse2, cpu_has_sse2},
+#endif
+    {"scalar", xor_kernel_scalar, xor_repeat_scalar, xor_multi_scalar, cpu_always},
+};
+
+// Entry i matches xor_kernels[i], so --kernel caps both at the same width
+static const gf_kernel gf_kernels[] = {
+#if XOR_X86
+    {"avx512bw", gf_mul_add_avx512, cpu_has_avx512bw},
+    {"avx2", gf_mul_add_avx2, cpu_has_avx2},
+    {"ssse3", gf_mul_add_ssse3, cpu_has_ssse3},
+#endif
+    {"scalar", gf_mul_add_scalar, cpu_always},
+};
+
+// Likewise matched to xor_kernels
+static const keystream_kernel keystream_kernels[] = {
+#if XOR_X86
+    {"avx512", chacha_blocks_avx512, 16, cpu_has_avx512},
+    {"avx2", chacha_blocks_avx2, 16, cpu_has_avx2},
+    {"sse2", chacha_blocks_sse2, 16, cpu_has_sse2},
+#endif
+    {"scalar", chacha_blocks_scalar, 1, cpu_always},
+};
+
+// Find a kernel by name, or the widest supported one for NULL, and the
+// GF(2^8) and ChaCha20 kernels no wider than it
+static int find_kernels(const char *name, kernel_set *set) {
+    size_t count = sizeof(xor_kernels) / sizeof(xor_kernels[0]);
+    size_t i = 0;
+    for (; i < count; i++) {
+        if (name == NULL ? xor_kernels[i].supported() : strcmp(name, xor_kernels[i].name) == 0) {
+            break;
+        }
+    }
+    if (i == count) {
+        return XOR_ERR_UNKNOWN_KERNEL;
+    }
+    if (!xor_kernels[i].supported()) {
+        return XOR_ERR_UNSUPPORTED;
+    }
+    set->xor = &xor_kernels[i];
+    set->gf = &gf_kernels[count - 1];
+    set->chacha = &keystream_kernels[count - 1];
+    for (size_t j = count; j-- > i; ) {
+        if (gf_kernels[j].supported()) {
+            set->gf = &gf_kernels[j];
+        }
+        if (keystream_kernels[j].supported()) {
+            set->chacha = &keystream_kernels[j];
+        }
+    }
+    return XOR_OK;
+}
+
+static void gf_init(void);
+
+static void init_kernels(void) {
+    find_kernels(NULL, &kernels);
+    gf_init();
+}
+
+static const kernel_set *active(void) {
+    pthread_once(&kernels_once, init_kernels);
+    return &kernels;
+}
+
+int xor_use_kernel(const char *name) {
+    active();
+    kernel_set set;
+    int status = find_kernels(name, &set);
+    if (status == XOR_OK) {
+        kernels = set;
+    }
+    return status;
+}
+
+const char *xor_kernel_name(void) {
+    return active()->xor->name;
+}
+
+const char *xor_gf_kernel_name(void) {
+    return active()->gf->name;
+}
+
+const char *xor_keystream_kernel_name(void) {
+    return active()->chacha->name;
+}
+
+const char *xor_strerror(int status) {
+    switch (status) {
+        case XOR_OK:
+            return "success";
+        case XOR_ERR_ARGUMENT:
+            return "invalid argument";
+        case XOR_ERR_NO_MEMORY:
+            return "memory allocation failed";
+        case XOR_ERR_UNKNOWN_KERNEL:
+            return "unknown kernel";
+        case XOR_ERR_UNSUPPORTED:
+            return "kernel not supported by this CPU";
+        default:
+            return "unknown error";
+    }
+}
+
+size_t xor_buffers(void *dst, const void *a, const void *b, size_t n) {
+    return active()->xor->fn(dst, a, b, n);
+}
+
+// Longer lists are folded in MULTI_MAX - 1 at a time, with dst carried
+// along as the first source
+size_t xor_buffers_multi(void *dst, const unsigned char *const *src, size_t count, size_t n) {
+    const xor_kernel *kernel = active()->xor;
+    const unsigned char *const *sources = src;
+    size_t first = (count < MULTI_MAX) ? count : MULTI_MAX;
+    size_t data_len = kernel->multi(dst, sources, first, n);
+    for (size_t done = first; done < count; ) {
+        const unsigned char *batch[MULTI_MAX];
+        size_t take = (count - done < MULTI_MAX - 1) ? count - done : MULTI_MAX - 1;
+        batch[0] = dst;
+        memcpy(batch + 1, sources + done, take * sizeof(*batch));
+        data_len = kernel->multi(dst, batch, take + 1, n);
+        done += take;
+    }
+    return data_len;
+}
+
+size_t xor_data_length(const void *buf, size_t n) {
+    return trim_zeros(buf, n);
+}
+
+void xor_gf_mul_add(void *dst, const void *src, const unsigned char tables[32], size_t n) {
+    active()->gf->fn(dst, src, tables, n);
+}
+
+// Set up a keystream from a seed of a 32-byte key, optionally followed by
+// up to 12 bytes of nonce; missing nonce bytes are zero
+int xor_keystream_init(xor_keystream *ks, const void *seed, size_t len) {
+    if (ks == NULL || seed == NULL || len < XOR_KEYSTREAM_KEY || len > XOR_KEYSTREAM_SEED) {
+        return XOR_ERR_ARGUMENT;
+    }
+    static const uint32_t sigma[4] = {0x61707865, 0x3320646e, 0x79622d32, 0x6b206574};
+    unsigned char words[48] = {0};
+    memcpy(words, seed, len < sizeof(words) ? len : sizeof(words));
+    memcpy(ks->state, sigma, sizeof(sigma));
+    for (int i = 0; i < 11; i++) {
+        const unsigned char *p = words + 4 * i;
+        ks->state[i < 8 ? 4 + i : 5 + i] = (uint32_t)p[0] | (uint32_t)p[1] << 8 |
+                                           (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+    }
+    ks->state[12] = 0;
+    memset(words, 0, sizeof(words));
+    return XOR_OK;
+}
+
+// The len keystream bytes starting at offset
+void xor_keystream_fill(const xor_keystream *ks, uint64_t offset, void *buf, size_t len) {
+    const keystream_kernel *chacha = active()->chacha;
+    unsigned char *out = buf;
+    uint64_t block = offset / 64;
+    size_t skip = (size_t)(offset % 64);
+    size_t batch_bytes = 64 * chacha->batch;
+    while (len > 0) {
+        if (skip == 0 && len >= batch_bytes) {
+            size_t blocks = len / batch_bytes * chacha->batch;
+            chacha->fn(ks->state, block, out, blocks);
+            block += blocks;
+            out += 64 * blocks;
+            len -= 64 * blocks;
+        } else {
+            unsigned char partial[64];
+            chacha_blocks_scalar(ks->state, block, partial, 1);
+            size_t n = (len < 64 - skip) ? len : 64 - skip;
+            memcpy(out, partial + skip, n);
+            block++;
+            out += n;
+            len -= n;
+            skip = 0;
+        }
+    }
+}
+
+// Reed-Solomon arithmetic: log and antilog tables for GF(2^8)
+static unsigned char gf_exp[512];
+static unsigned char gf_log[256];
+
+static void gf_init(void) {
+    unsigned x = 1;
+    for (unsigned i = 0; i < 255; i++) {
+        gf_exp[i] = (unsigned char)x;
+        gf_exp[i + 255] = (unsigned char)x;
+        gf_log[x] = (unsigned char)i;
+        x <<= 1;
+        if (x & 0x100) {
+            x ^= GF_POLY;
+        }
+    }
+}
+
+unsigned char xor_gf_mul(unsigned char a, unsigned char b) {
+    active();
+    if (a == 0 || b == 0) {
+        return 0;
+    }
+    return gf_exp[gf_log[a] + gf_log[b]];
+}
+
+unsigned char xor_gf_div(unsigned char a, unsigned char b) {
+    assert(b != 0);
+    active();
+    if (a == 0) {
+        return 0;
+    }
+    return gf_exp[gf_log[a] + 255 - gf_log[b]];
+}
+
+// The split tables used by the gf_mul_fn kernels for multiplying by c
+void xor_gf_tables(unsigned char c, unsigned char tables[32]) {
+    for (unsigned x = 0; x < 16; x++) {
+        tables[x] = xor_gf_mul(c, (unsigned char)x);
+        tables[16 + x] = xor_gf_mul(c, (unsigned char)(x << 4));
+    }
+}
+
+// A repeating key is stored repeated out to KEY_SPAN + len bytes, so the
+// key for any span starts at expanded + (offset % len) and runs on
+// without wrapping. Keys whose length divides 64 are held in registers by
+// the kernel's repeat function instead. A keystream key has stream set
+// and the other fields unused.
+struct xor_key {
+    unsigned char *expanded;
+    size_t len;
+    bool in_register;
+    xor_keystream *stream;
+};
+
+int xor_key_new(xor_key **key, const void *bytes, size_t len) {
+    if (key == NULL || bytes == NULL || len == 0 || len > XOR_KEY_MAX) {
+        return XOR_ERR_ARGUMENT;
+    }
+    xor_key *k = calloc(1, sizeof(*k));
+    if (k == NULL) {
+        return XOR_ERR_NO_MEMORY;
+    }
+    if (posix_memalign((void **)&k->expanded, 64, KEY_SPAN + len) != 0) {
+        free(k);
+        return XOR_ERR_NO_MEMORY;
+    }
+    for (size_t i = 0; i < KEY_SPAN + len; i += len) {
+        size_t n = (KEY_SPAN + len - i < len) ? KEY_SPAN + len - i : len;
+        memcpy(k->expanded + i, bytes, n);
+    }
+    k->len = len;
+    k->in_register = 64 % len == 0;
+    *key = k;
+    return XOR_OK;
+}
+
+int xor_key_new_keystream(xor_key **key, const void *seed, size_t len) {
+    if (key == NULL) {
+        return XOR_ERR_ARGUMENT;
+    }
+    xor_key *k = calloc(1, sizeof(*k));
+    if (k == NULL || (k->stream = malloc(sizeof(*k->stream))) == NULL) {
+        free(k);
+        return XOR_ERR_NO_MEMORY;
+    }
+    int status = xor_keystream_init(k->stream, seed, len);
+    if (status != XOR_OK) {
+        xor_key_free(k);
+        return status;
+    }
+    *key = k;
+    return XOR_OK;
+}
+
+void xor_key_free(xor_key *key) {
+    if (key == NULL) {
+        return;
+    }
+    if (key->stream != NULL) {
+        memset(key->stream, 0, sizeof(*key->stream));
+        free(key->stream);
+    }
+    if (key->expanded != NULL) {
+        memset(key->expanded, 0, KEY_SPAN + key->len);
+        free(key->expanded);
+    }
+    free(key);
+}
+
+size_t xor_key_length(const xor_key *key) {
+    return key->len;
+}
+
+int xor_key_in_registers(const xor_key *key) {
+    return key->in_register;
+}
+
+// A keystream is generated into dst first, which is why dst must not
+// overlap src
+size_t xor_key_apply(const xor_key *key, void *dst_buf, const void *src_buf, size_t len,
+                     uint64_t offset) {
+    const xor_kernel *kernel = active()->xor;
+    unsigned char *dst = dst_buf;
+    const unsigned char *data = src_buf;
+    size_t data_len = 0;
+    for (size_t i = 0; i < len; i += KEY_SPAN) {
+        size_t n = (len - i < KEY_SPAN) ? len - i : KEY_SPAN;
+        size_t end;
+        if (key->stream != NULL) {
+            xor_keystream_fill(key->stream, offset + i, dst + i, n);
+            end = kernel->fn(dst + i, data + i, dst + i, n);
+        } else {
+            const unsigned char *k = key->expanded + (offset + i) % key->len;
+            end = key->in_register ? kernel->repeat(dst + i, data + i, k, n)
+                                   : kernel->fn(dst + i, data + i, k, n);
+        }
+        if (end > 0) {
+            data_len = i + end;
+        }
+    }
+    return data_len;
+}
+
+struct xor_stream {
+    const xor_key *key;
+    uint64_t offset;          // Bytes processed so far
+    uint64_t data_end;        // End of the last nonzero output byte
+};
+
+int xor_stream_init(xor_stream **stream, const xor_key *key) {
+    if (stream == NULL) {
+        return XOR_ERR_ARGUMENT;
+    }
+    *stream = calloc(1, sizeof(**stream));
+    if (*stream == NULL) {
+        return XOR_ERR_NO_MEMORY;
+    }
+    (*stream)->key = key;
+    return XOR_OK;
+}
+
+int xor_stream_update(xor_stream *stream, void *out_buf, const void *a, const void *b, size_t n) {
+    if (stream == NULL || (n > 0 && out_buf == NULL) || (stream->key != NULL && n > 0 && a == NULL)) {
+        return XOR_ERR_ARGUMENT;
+    }
+    const xor_kernel *kernel = active()->xor;
+    unsigned char *out = out_buf;
+    size_t data_len = 0;
+    if (stream->key != NULL) {
+        data_len = xor_key_apply(stream->key, out, a, n, stream->offset);
+    } else {
+        // Either side may be a run of zeros
+        for (size_t i = 0; i < n; i += KEY_SPAN) {
+            size_t len = (n - i < KEY_SPAN) ? n - i : KEY_SPAN;
+            const unsigned char *pa = (a != NULL) ? (const unsigned char *)a + i : zero_span;
+            const unsigned char *pb = (b != NULL) ? (const unsigned char *)b + i : zero_span;
+            size_t end = kernel->fn(out + i, pa, pb, len);
+            if (end > 0) {
+                data_len = i + end;
+            }
+        }
+    }
+    if (data_len > 0) {
+        stream->data_end = stream->offset + data_len;
+    }
+    stream->offset += n;
+    return XOR_OK;
+}
+
+int xor_stream_tell(const xor_stream *stream, uint64_t *length, uint64_t *data_end) {
+    if (stream == NULL) {
+        return XOR_ERR_ARGUMENT;
+    }
+    if (length != NULL) {
+        *length = stream->offset;
+    }
+    if (data_end != NULL) {
+        *data_end = stream->data_end;
+    }
+    return XOR_OK;
+}
+
+int xor_stream_finish(xor_stream *stream, uint64_t *length, uint64_t *data_end) {
+    int status = xor_stream_tell(stream, length, data_end);
+    free(stream);
+    return status;
+}
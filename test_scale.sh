@@ -0,0 +1,156 @@
+#!/bin/bash
+set -euo pipefail
+
+# XOR Tool Scaling Tests
+# Streams progressively larger inputs, generated on the fly, through ./xor
+# and fails if peak memory passes a cap or grows with the input, or if the
+# time per byte grows with the input. Data comes from pipes so that no
+# file is mapped, and output goes to /dev/null, so nothing touches disk.
+#
+# Settings, from the environment:
+#   SCALE_SIZES        stream sizes, smallest first (default: 64M 256M 1G 4G)
+#   SCALE_RSS_CAP_MB   peak RSS allowed at any size (default: 64)
+#   SCALE_RSS_SLACK_KB allowed RSS growth from smallest to largest (default: 8192)
+#   SCALE_TIME_FACTOR  allowed growth in time per byte (default: 2)
+
+GREEN='\033[0;32m'
+RED='\033[0;31m'
+YELLOW='\033[1;33m'
+BLUE='\033[1;34m'
+NC='\033[0m'
+
+SIZES=${SCALE_SIZES:-64M 256M 1G 4G}
+RSS_CAP_KB=$(( ${SCALE_RSS_CAP_MB:-64} * 1024 ))
+RSS_SLACK_KB=${SCALE_RSS_SLACK_KB:-8192}
+TIME_FACTOR=${SCALE_TIME_FACTOR:-2}
+
+TESTS_PASSED=0
+TESTS_FAILED=0
+
+XOR=./xor
+RUNNER=./bench_run
+if [ ! -x "$XOR" ] || [ ! -x "$RUNNER" ]; then
+    echo "test_scale.sh: build first with: make xor bench_run" >&2
+    exit 2
+fi
+
+cleanup() {
+    rm -f scale_*.tmp
+}
+trap cleanup EXIT
+
+pass_test() {
+    echo -e "${GREEN}✓ $1${NC}"
+    TESTS_PASSED=$((TESTS_PASSED + 1))
+}
+
+fail_test() {
+    echo -e "${RED}✗ $1${NC}"
+    TESTS_FAILED=$((TESTS_FAILED + 1))
+}
+
+# 4K, 64M, 4G and plain byte counts to bytes
+to_bytes() {
+    local size=$1
+    case "$size" in
+        *K) echo $(( ${size%K} * 1024 )) ;;
+        *M) echo $(( ${size%M} * 1024 * 1024 )) ;;
+        *G) echo $(( ${size%G} * 1024 * 1024 * 1024 )) ;;
+        *) echo "$size" ;;
+    esac
+}
+
+# N bytes of nonzero text, so no trailing zeros are held back; yes is
+# stopped by SIGPIPE when head has enough
+generate() {
+    { yes "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ.,;:!?" || true; } | head -c "$1"
+}
+
+generate_other() {
+    { yes "The quick brown fox jumps over the lazy dog, again and again and again" || true; } | head -c "$1"
+}
+
+# Run one case at one size; leaves "rss_kb ns_per_byte" in scale_result.tmp
+run_case() {
+    local case_name=$1 bytes=$2
+    case "$case_name" in
+        "two pipes")
+            generate "$bytes" | "$RUNNER" scale_metrics.tmp -- "$XOR" - <(generate_other "$bytes") > /dev/null
+            ;;
+        "pipe and keystream")
+            generate "$bytes" | "$RUNNER" scale_metrics.tmp -- "$XOR" - chacha20:scale_seed.tmp > /dev/null
+            ;;
+        "pipe and repeating key")
+            generate "$bytes" | "$RUNNER" scale_metrics.tmp -- "$XOR" --repeat-key - scale_key.tmp > /dev/null
+            ;;
+        "pipe padded by a short file")
+            generate "$bytes" | "$RUNNER" scale_metrics.tmp -- "$XOR" - scale_key.tmp > /dev/null
+            ;;
+    esac
+    local wall cpu cycles rss source
+    read -r wall cpu cycles rss source < scale_metrics.tmp
+    awk -v rss="$rss" -v wall="$wall" -v bytes="$bytes" 'BEGIN { printf "%d %.6f\n", rss, wall * 1e9 / bytes }' > scale_result.tmp
+}
+
+"$XOR" --keygen 44 -o scale_seed.tmp
+head -c 4093 /dev/urandom > scale_key.tmp
+
+echo -e "${BLUE}=== Scaling Tests ===${NC}"
+echo "Sizes: $SIZES; RSS cap $((RSS_CAP_KB / 1024))MB"
+echo
+
+for case_name in "two pipes" "pipe and keystream" "pipe and repeating key" "pipe padded by a short file"; do
+    first_rss=""
+    first_ns=""
+    last_rss=0
+    last_ns=0
+    capped=true
+    for size in $SIZES; do
+        bytes=$(to_bytes "$size")
+        run_case "$case_name" "$bytes"
+        read -r rss ns < scale_result.tmp
+        echo -e "  ${YELLOW}$case_name, $size${NC}: ${rss}KB peak RSS, ${ns} ns/byte"
+        if [ "$rss" -gt "$RSS_CAP_KB" ]; then
+            capped=false
+        fi
+        if [ -z "$first_rss" ]; then
+            first_rss=$rss
+            first_ns=$ns
+        fi
+        last_rss=$rss
+        last_ns=$ns
+    done
+
+    if $capped; then
+        pass_test "$case_name: memory under the cap"
+    else
+        fail_test "$case_name: peak RSS above $((RSS_CAP_KB / 1024))MB"
+    fi
+    if [ $((last_rss - first_rss)) -le "$RSS_SLACK_KB" ]; then
+        pass_test "$case_name: constant memory"
+    else
+        fail_test "$case_name: peak RSS grew from ${first_rss}KB to ${last_rss}KB"
+    fi
+    if awk -v first="$first_ns" -v last="$last_ns" -v factor="$TIME_FACTOR" 'BEGIN { exit !(last <= first * factor) }'; then
+        pass_test "$case_name: linear time"
+    else
+        fail_test "$case_name: time per byte grew from $first_ns to $last_ns ns"
+    fi
+    echo
+done
+
+
+# Summary
+echo "=== Test Results ==="
+echo "Total: $((TESTS_PASSED + TESTS_FAILED))"
+echo -e "Passed: ${GREEN}$TESTS_PASSED${NC}"
+echo -e "Failed: ${RED}$TESTS_FAILED${NC}"
+echo
+
+if [ $TESTS_FAILED -eq 0 ]; then
+    echo -e "${GREEN}🎉 All tests passed!${NC}"
+    exit 0
+else
+    echo -e "${RED}❌ Some tests failed.${NC}"
+    exit 1
+fi
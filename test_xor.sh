@@ -135,9 +135,8 @@ echo -e "${BLUE}=== Argument Validation Tests ===${NC}"
 echo
 
 # Error tests
-test_error "No arguments" "requires exactly two file arguments" ./xor
-test_error "One argument only" "requires exactly two file arguments" ./xor test_text.tmp
-test_error "Too many arguments" "requires exactly two file arguments" ./xor test_text.tmp test_binary.tmp test_multiline.tmp
+test_error "No arguments" "requires at least two file arguments" ./xor
+test_error "One argument only" "requires at least two file arguments" ./xor test_text.tmp
 test_error "Nonexistent first file" "first input file not found" ./xor nonexistent.tmp test_text.tmp
 test_error "Nonexistent second file" "second input file not found" ./xor test_text.tmp nonexistent.tmp
 test_error "Same file twice" "cannot use the same file for both inputs" ./xor test_text.tmp test_text.tmp
@@ -277,6 +276,869 @@ fi
 rm -f preserve_result1.tmp preserve_result2.tmp normal_result1.tmp
 rm -f preserve_diff_result.tmp normal_diff_result.tmp short_file.tmp long_file.tmp
 
+echo
+echo -e "${BLUE}=== Streaming Tests ===${NC}"
+echo
+
+# Zero runs that straddle 64KB chunk boundaries must be held back, then
+# written once later data shows they are not trailing
+{ printf 'head'; head -c 200000 /dev/zero; printf 'tail'; } > stream_data.tmp
+{ cat stream_data.tmp; head -c 100000 /dev/zero; } > stream_gaps.tmp
+head -c 70000 /dev/zero > stream_zeros.tmp
+test_roundtrip "Zero runs across chunk boundaries" stream_data.tmp test_key.tmp
+
+echo -ne "${YELLOW}Testing: Held-back zeros${NC} ... "
+./xor stream_gaps.tmp stream_zeros.tmp > stream_result.tmp
+./xor -z stream_gaps.tmp stream_zeros.tmp > stream_preserved.tmp
+if [ "$(wc -c < stream_result.tmp)" -eq 200008 ] && cmp -s stream_gaps.tmp stream_preserved.tmp; then
+    pass_test "Held-back zeros"
+else
+    fail_test "Held-back zeros - got $(wc -c < stream_result.tmp) stripped, $(wc -c < stream_preserved.tmp) preserved bytes"
+fi
+
+rm -f stream_data.tmp stream_gaps.tmp stream_zeros.tmp stream_result.tmp stream_preserved.tmp
+
+echo
+echo -e "${BLUE}=== Kernel Tests ===${NC}"
+echo
+
+# Every kernel the CPU supports must produce identical output, including
+# the unaligned tails that fall back to the scalar loop
+head -c 100003 /dev/urandom > kernel_a.tmp
+head -c 70001 /dev/urandom > kernel_b.tmp
+./xor -z --kernel=scalar kernel_a.tmp kernel_b.tmp > kernel_expected.tmp
+for k in sse2 avx2 avx512; do
+    echo -ne "${YELLOW}Testing: $k kernel${NC} ... "
+    if ! ./xor -z --kernel=$k kernel_a.tmp kernel_b.tmp > kernel_result.tmp 2>/dev/null; then
+        echo "not supported, skipped"
+    elif cmp -s kernel_expected.tmp kernel_result.tmp; then
+        pass_test "$k kernel matches scalar"
+    else
+        fail_test "$k kernel differs from scalar"
+    fi
+done
+
+# A mostly-zero delta: the kernels must locate the last nonzero byte
+{ head -c 100000 kernel_a.tmp; printf 'Z'; tail -c +100002 kernel_a.tmp; } > kernel_delta.tmp
+for k in scalar sse2 avx2 avx512; do
+    echo -ne "${YELLOW}Testing: $k last nonzero byte${NC} ... "
+    if ! size=$(./xor --kernel=$k kernel_a.tmp kernel_delta.tmp 2>/dev/null | wc -c); then
+        echo "not supported, skipped"
+    elif [ "$size" -eq 100001 ]; then
+        pass_test "$k kernel finds the last nonzero byte"
+    else
+        fail_test "$k kernel stripped to $size bytes, expected 100001"
+    fi
+done
+
+test_error "Unknown kernel" "unknown kernel: bogus" ./xor --kernel=bogus test_text.tmp test_key.tmp
+
+rm -f kernel_a.tmp kernel_b.tmp kernel_delta.tmp kernel_expected.tmp kernel_result.tmp
+
+echo
+echo -e "${BLUE}=== I/O Engine Tests ===${NC}"
+echo
+
+# Mapped inputs cross several 16MB mapping windows here
+head -c 40000123 /dev/urandom > engine_a.tmp
+head -c 17000000 /dev/urandom > engine_b.tmp
+./xor --io=stdio engine_a.tmp engine_b.tmp > engine_expected.tmp
+
+echo -ne "${YELLOW}Testing: mmap engine${NC} ... "
+if ./xor --io=mmap engine_a.tmp engine_b.tmp | cmp -s engine_expected.tmp -; then
+    pass_test "mmap engine matches stdio"
+else
+    fail_test "mmap engine differs from stdio"
+fi
+
+echo -ne "${YELLOW}Testing: mapped stdin redirect${NC} ... "
+if ./xor engine_a.tmp - < engine_b.tmp | cmp -s engine_expected.tmp -; then
+    pass_test "stdin redirected from a regular file"
+else
+    fail_test "stdin redirected from a regular file - output differs"
+fi
+
+echo -ne "${YELLOW}Testing: pipe falls back to stdio${NC} ... "
+if cat engine_b.tmp | ./xor --io=mmap engine_a.tmp - | cmp -s engine_expected.tmp -; then
+    pass_test "pipe input with mmap engine"
+else
+    fail_test "pipe input with mmap engine - output differs"
+fi
+
+echo -ne "${YELLOW}Testing: pipeline engine${NC} ... "
+if ./xor --io=pipeline engine_a.tmp engine_b.tmp | cmp -s engine_expected.tmp - &&
+   cat engine_a.tmp | ./xor --io=pipeline - engine_b.tmp | cmp -s engine_expected.tmp -; then
+    pass_test "pipeline engine matches stdio"
+else
+    fail_test "pipeline engine differs from stdio"
+fi
+
+echo -ne "${YELLOW}Testing: pipeline engine preserving zeros${NC} ... "
+head -c 300000 /dev/zero > engine_zeros.tmp
+if [ "$(./xor -z --io=pipeline test_small.tmp engine_zeros.tmp | wc -c)" -eq 300000 ]; then
+    pass_test "pipeline engine preserving zeros"
+else
+    fail_test "pipeline engine preserving zeros - wrong length"
+fi
+
+echo -ne "${YELLOW}Testing: uring engine${NC} ... "
+if ./xor --io=uring engine_a.tmp engine_b.tmp | cmp -s engine_expected.tmp - &&
+   cat engine_a.tmp | ./xor --io=uring - engine_b.tmp | cmp -s engine_expected.tmp - &&
+   ./xor --io=uring -o engine_result.tmp engine_b.tmp - < engine_a.tmp &&
+   cmp -s engine_expected.tmp engine_result.tmp; then
+    pass_test "uring engine (or its stdio fallback) matches stdio"
+else
+    fail_test "uring engine differs from stdio"
+fi
+
+echo -ne "${YELLOW}Testing: engine choice kept with -o${NC} ... "
+ok=true
+for engine in stdio pipeline uring; do
+    ./xor -p --io=$engine -o engine_result.tmp engine_a.tmp engine_b.tmp 2> engine_log.tmp
+    cmp -s engine_expected.tmp engine_result.tmp || ok=false
+    grep -q "threads)" engine_log.tmp && ok=false
+done
+./xor -p --splice -o engine_result.tmp engine_a.tmp engine_b.tmp 2> engine_log.tmp
+grep -q "not a pipe" engine_log.tmp || ok=false
+if $ok; then
+    pass_test "engine choice kept with -o"
+else
+    fail_test "engine choice kept with -o - the parallel engine was used"
+fi
+
+test_error "Jobs with an engine" "--jobs cannot be combined with --io or --splice" \
+    ./xor -j 2 --io=pipeline -o engine_result.tmp engine_a.tmp engine_b.tmp
+
+echo -ne "${YELLOW}Testing: uring engine appending to a file${NC} ... "
+echo "header" > engine_result.tmp
+./xor --io=uring -z test_small.tmp engine_zeros.tmp >> engine_result.tmp
+if [ "$(wc -c < engine_result.tmp)" -eq 300007 ] && [ "$(head -n 1 engine_result.tmp)" = "header" ]; then
+    pass_test "uring engine appending to a file"
+else
+    fail_test "uring engine appending to a file - got $(wc -c < engine_result.tmp) bytes"
+fi
+
+echo -ne "${YELLOW}Testing: splice output to a pipe${NC} ... "
+if ./xor --splice engine_a.tmp engine_b.tmp | cmp -s engine_expected.tmp - &&
+   [ "$(./xor --splice -z test_small.tmp engine_zeros.tmp | wc -c)" -eq 300000 ] &&
+   ./xor --splice -o engine_result.tmp engine_a.tmp engine_b.tmp &&
+   cmp -s engine_expected.tmp engine_result.tmp; then
+    pass_test "splice output matches stdio"
+else
+    fail_test "splice output differs from stdio"
+fi
+
+test_error "Unknown I/O engine" "unknown I/O engine: bogus" ./xor --io=bogus test_text.tmp test_key.tmp
+
+rm -f engine_a.tmp engine_b.tmp engine_zeros.tmp engine_expected.tmp engine_result.tmp engine_log.tmp
+
+echo
+echo -e "${BLUE}=== Output File Tests ===${NC}"
+echo
+
+# Sizes chosen so the 1MB parallel work items end unevenly
+head -c 5000000 /dev/urandom > output_a.tmp
+{ head -c 3000000 output_a.tmp; head -c 1234567 /dev/urandom; } > output_b.tmp
+./xor output_a.tmp output_b.tmp > output_expected.tmp
+./xor -z output_a.tmp output_b.tmp > output_expected_z.tmp
+
+for j in 1 4; do
+    echo -ne "${YELLOW}Testing: -o with $j threads${NC} ... "
+    ./xor -j $j -o output_result.tmp output_a.tmp output_b.tmp
+    ./xor -z -j $j -o output_result_z.tmp output_b.tmp output_a.tmp
+    if cmp -s output_expected.tmp output_result.tmp && cmp -s output_expected_z.tmp output_result_z.tmp; then
+        pass_test "-o with $j threads"
+    else
+        fail_test "-o with $j threads - output differs"
+    fi
+done
+
+echo -ne "${YELLOW}Testing: -o with stdin input${NC} ... "
+if ./xor -o output_result.tmp output_a.tmp - < output_b.tmp && cmp -s output_expected.tmp output_result.tmp; then
+    pass_test "-o with stdin input"
+else
+    fail_test "-o with stdin input - output differs"
+fi
+
+echo -ne "${YELLOW}Testing: -o truncates trailing zeros from a stream${NC} ... "
+head -c 6000000 /dev/zero | ./xor -o output_result.tmp output_b.tmp -
+head -c 6000000 /dev/zero | ./xor -z --io=pipeline -o output_result_z.tmp output_b.tmp -
+if cmp -s output_b.tmp output_result.tmp && [ "$(wc -c < output_result_z.tmp)" -eq 6000000 ] &&
+   cmp -s output_b.tmp <(head -c 4234567 output_result_z.tmp); then
+    pass_test "-o truncates trailing zeros from a stream"
+else
+    fail_test "-o truncates trailing zeros from a stream - got $(wc -c < output_result.tmp) bytes"
+fi
+
+echo -ne "${YELLOW}Testing: -o with sparse inputs${NC} ... "
+rm -f output_sparse.tmp
+truncate -s 20M output_sparse.tmp
+dd if=output_a.tmp of=output_sparse.tmp bs=1M count=2 seek=5 conv=notrunc 2>/dev/null
+./xor -z output_sparse.tmp output_b.tmp > output_expected_z.tmp
+./xor -z -j 2 -o output_result_z.tmp output_sparse.tmp output_b.tmp
+# Only a filesystem that kept the input sparse can keep the output sparse
+if cmp -s output_expected_z.tmp output_result_z.tmp &&
+   { [ "$(du -k output_sparse.tmp | cut -f1)" -ge 20000 ] || [ "$(du -k output_result_z.tmp | cut -f1)" -lt 10000 ]; }; then
+    pass_test "-o with sparse inputs"
+else
+    fail_test "-o with sparse inputs - output differs or holes were filled"
+fi
+
+echo -ne "${YELLOW}Testing: short key against a long file${NC} ... "
+head -c 1000 output_a.tmp > output_key.tmp
+{ head -c 1000 /dev/zero; tail -c +1001 output_a.tmp; head -c 70000 /dev/zero; } > output_expected_z.tmp
+head -c 5000000 output_expected_z.tmp > output_expected.tmp
+./xor -o output_result.tmp output_key.tmp output_expected_z.tmp
+./xor -z output_expected_z.tmp output_key.tmp > output_result_z.tmp
+if cmp -s output_expected.tmp <(./xor output_key.tmp output_expected_z.tmp | ./xor output_key.tmp -) &&
+   cmp -s output_a.tmp output_result.tmp && cmp -s output_a.tmp <(head -c 5000000 output_result_z.tmp) &&
+   [ "$(wc -c < output_result_z.tmp)" -eq 5070000 ]; then
+    pass_test "short key against a long file"
+else
+    fail_test "short key against a long file - tail copy differs"
+fi
+
+test_error "Output overwrites input" "cannot use an input file as the output" ./xor -o output_a.tmp output_a.tmp output_b.tmp
+test_error "Jobs without output" "--jobs requires --output" ./xor -j 2 output_a.tmp output_b.tmp
+test_error "Invalid job count" "invalid job count: many" ./xor -j many -o output_result.tmp output_a.tmp output_b.tmp
+
+rm -f output_a.tmp output_b.tmp output_key.tmp output_sparse.tmp output_expected.tmp output_expected_z.tmp output_result.tmp output_result_z.tmp
+
+echo
+echo -e "${BLUE}=== In-Place Tests ===${NC}"
+echo
+
+head -c 3000000 /dev/urandom > inplace_a.tmp
+{ head -c 1000000 /dev/urandom; head -c 500000 /dev/zero; } > inplace_key.tmp
+./xor inplace_a.tmp inplace_key.tmp > inplace_expected.tmp
+
+for j in 1 4; do
+    echo -ne "${YELLOW}Testing: --in-place with $j threads${NC} ... "
+    cp inplace_a.tmp inplace_result.tmp
+    ./xor --in-place -j $j inplace_result.tmp inplace_key.tmp
+    cp inplace_key.tmp inplace_longer.tmp
+    ./xor -i -j $j inplace_longer.tmp inplace_a.tmp
+    if cmp -s inplace_expected.tmp inplace_result.tmp && cmp -s inplace_expected.tmp inplace_longer.tmp; then
+        pass_test "--in-place with $j threads"
+    else
+        fail_test "--in-place with $j threads - result differs"
+    fi
+done
+
+echo -ne "${YELLOW}Testing: --in-place from stdin strips trailing zeros${NC} ... "
+cp inplace_key.tmp inplace_result.tmp
+./xor -i inplace_result.tmp - < inplace_key.tmp
+cp inplace_key.tmp inplace_longer.tmp
+cat inplace_key.tmp | ./xor -i -z inplace_longer.tmp -
+if [ ! -s inplace_result.tmp ] && [ "$(wc -c < inplace_longer.tmp)" -eq 1500000 ] &&
+   [ -z "$(tr -d '\0' < inplace_longer.tmp | head -c 1)" ]; then
+    pass_test "--in-place from stdin strips trailing zeros"
+else
+    fail_test "--in-place from stdin - got $(wc -c < inplace_result.tmp) bytes"
+fi
+
+test_error "In-place onto itself" "cannot use the same file for both inputs" ./xor -i inplace_a.tmp - < inplace_a.tmp
+test_error "In-place with output" "--in-place cannot be combined with --output" ./xor -i -o inplace_result.tmp inplace_a.tmp inplace_key.tmp
+
+rm -f inplace_a.tmp inplace_key.tmp inplace_expected.tmp inplace_result.tmp inplace_longer.tmp
+
+echo
+echo -e "${BLUE}=== Repeating Key Tests ===${NC}"
+echo
+
+# Expected output comes from a key file repeated out to the data length
+head -c 300007 /dev/urandom > repeat_data.tmp
+for len in 32 100; do
+    head -c $len /dev/urandom > repeat_key.tmp
+    cp repeat_key.tmp repeat_full.tmp
+    while [ "$(wc -c < repeat_full.tmp)" -lt 300007 ]; do
+        cat repeat_full.tmp repeat_full.tmp > repeat_tmp.tmp && mv repeat_tmp.tmp repeat_full.tmp
+    done
+    ./xor -z repeat_data.tmp <(head -c 300007 repeat_full.tmp) > repeat_expected.tmp
+    for k in scalar sse2 avx2 avx512; do
+        echo -ne "${YELLOW}Testing: $len byte repeating key, $k kernel${NC} ... "
+        if ! ./xor -z --kernel=$k --repeat-key repeat_data.tmp repeat_key.tmp > repeat_result.tmp 2>/dev/null; then
+            echo "not supported, skipped"
+        elif cmp -s repeat_expected.tmp repeat_result.tmp; then
+            pass_test "$len byte repeating key, $k kernel"
+        else
+            fail_test "$len byte repeating key, $k kernel - output differs"
+        fi
+    done
+done
+
+echo -ne "${YELLOW}Testing: repeating key with -o, -j and --in-place${NC} ... "
+./xor -z -j 4 --repeat-key -o repeat_result.tmp repeat_data.tmp repeat_key.tmp
+cp repeat_data.tmp repeat_inplace.tmp
+./xor -z -i --repeat-key repeat_inplace.tmp - < repeat_key.tmp
+if cmp -s repeat_expected.tmp repeat_result.tmp && cmp -s repeat_expected.tmp repeat_inplace.tmp; then
+    pass_test "repeating key with -o, -j and --in-place"
+else
+    fail_test "repeating key with -o, -j and --in-place - output differs"
+fi
+
+test_error "Empty repeating key" "key file is empty" ./xor --repeat-key repeat_data.tmp /dev/null
+
+rm -f repeat_data.tmp repeat_key.tmp repeat_full.tmp repeat_expected.tmp repeat_result.tmp repeat_inplace.tmp
+
+echo
+echo -e "${BLUE}=== N-Way Tests ===${NC}"
+echo
+
+head -c 300000 /dev/urandom > nway_a.tmp
+head -c 250001 /dev/urandom > nway_b.tmp
+head -c 200000 /dev/urandom > nway_c.tmp
+{ head -c 100 /dev/urandom; head -c 1000 /dev/zero; } > nway_d.tmp
+./xor -z nway_a.tmp nway_b.tmp > nway_ab.tmp
+./xor -z nway_ab.tmp nway_c.tmp > nway_abc.tmp
+./xor -z nway_abc.tmp nway_d.tmp > nway_expected.tmp
+
+for k in scalar sse2 avx2 avx512; do
+    echo -ne "${YELLOW}Testing: four files, $k kernel${NC} ... "
+    if ! ./xor -z --kernel=$k nway_a.tmp nway_b.tmp nway_c.tmp nway_d.tmp > nway_result.tmp 2>/dev/null; then
+        echo "not supported, skipped"
+    elif cmp -s nway_expected.tmp nway_result.tmp; then
+        pass_test "four files, $k kernel"
+    else
+        fail_test "four files, $k kernel - output differs"
+    fi
+done
+
+echo -ne "${YELLOW}Testing: N-way with stdin, -o and stripping${NC} ... "
+cp nway_a.tmp nway_a2.tmp
+./xor -o nway_result.tmp nway_c.tmp - nway_b.tmp < nway_a.tmp
+if cmp -s <(./xor nway_abc.tmp /dev/null) nway_result.tmp &&
+   cmp -s nway_d.tmp <(./xor -z nway_a.tmp nway_d.tmp nway_a2.tmp | head -c 1100) &&
+   [ "$(./xor nway_a.tmp nway_d.tmp nway_a2.tmp | wc -c)" -eq 100 ]; then
+    pass_test "N-way with stdin, -o and stripping"
+else
+    fail_test "N-way with stdin, -o and stripping - output differs"
+fi
+
+test_error "Same file in N-way" "cannot use the same file for two inputs" ./xor nway_a.tmp nway_b.tmp nway_a.tmp
+test_error "Jobs with N-way" "--jobs supports only two input files" ./xor -j 2 -o nway_result.tmp nway_a.tmp nway_b.tmp nway_c.tmp
+
+rm -f nway_a.tmp nway_a2.tmp nway_b.tmp nway_c.tmp nway_d.tmp nway_ab.tmp nway_abc.tmp nway_expected.tmp nway_result.tmp
+
+echo
+echo -e "${BLUE}=== Parity Tests ===${NC}"
+echo
+
+head -c 3000000 /dev/urandom > parity_1.tmp
+{ head -c 1000 /dev/urandom; head -c 5000 /dev/zero; } > parity_2.tmp
+head -c 2500001 /dev/urandom > parity_3.tmp
+./xor parity -j 2 parity_set.tmp parity_1.tmp parity_2.tmp parity_3.tmp
+
+for i in 1 2 3; do
+    echo -ne "${YELLOW}Testing: rebuild file $i of 3${NC} ... "
+    mv parity_$i.tmp parity_saved.tmp
+    if ./xor rebuild -j 3 parity_set.tmp parity_1.tmp parity_2.tmp parity_3.tmp &&
+       cmp -s parity_saved.tmp parity_$i.tmp; then
+        pass_test "rebuild file $i of 3"
+    else
+        fail_test "rebuild file $i of 3 - rebuilt file differs"
+    fi
+    mv parity_saved.tmp parity_$i.tmp
+done
+
+test_error "Rebuild with nothing missing" "nothing to rebuild" ./xor rebuild parity_set.tmp parity_1.tmp parity_2.tmp parity_3.tmp
+test_error "Rebuild with wrong file count" "parity file covers 3 data files, 2 given" ./xor rebuild parity_set.tmp parity_1.tmp parity_missing.tmp
+test_error "Rebuild from a data file" "not a parity file" ./xor rebuild parity_1.tmp parity_2.tmp parity_missing.tmp
+
+rm -f parity_1.tmp parity_2.tmp parity_3.tmp parity_set.tmp parity_saved.tmp
+
+echo
+echo -e "${BLUE}=== Reed-Solomon Tests ===${NC}"
+echo
+
+head -c 3000000 /dev/urandom > rs_1.tmp
+{ head -c 1000 /dev/urandom; head -c 5000 /dev/zero; } > rs_2.tmp
+head -c 2500001 /dev/urandom > rs_3.tmp
+head -c 77777 /dev/urandom > rs_4.tmp
+./xor parity -m 2 -j 2 rs_set.tmp rs_1.tmp rs_2.tmp rs_3.tmp rs_4.tmp
+mkdir -p rs_saved.tmp
+cp rs_?.tmp rs_set.tmp.? rs_saved.tmp/
+
+echo -ne "${YELLOW}Testing: first parity file is the XOR parity${NC} ... "
+if tail -c +4097 rs_set.tmp.1 | cmp -s - <(./xor -z rs_1.tmp rs_2.tmp rs_3.tmp rs_4.tmp); then
+    pass_test "first parity file is the XOR parity"
+else
+    fail_test "first parity file is the XOR parity - parity differs"
+fi
+
+echo -ne "${YELLOW}Testing: scalar GF(2^8) kernel matches${NC} ... "
+./xor parity -m 2 --kernel scalar rs_alt.tmp rs_1.tmp rs_2.tmp rs_3.tmp rs_4.tmp
+if cmp -s rs_set.tmp.2 rs_alt.tmp.2; then
+    pass_test "scalar GF(2^8) kernel matches"
+else
+    fail_test "scalar GF(2^8) kernel matches - parity differs"
+fi
+rm -f rs_alt.tmp.1 rs_alt.tmp.2
+
+for lost in "rs_1.tmp rs_3.tmp" "rs_2.tmp rs_4.tmp" "rs_4.tmp rs_set.tmp.1" "rs_set.tmp.2"; do
+    echo -ne "${YELLOW}Testing: rebuild after losing $lost${NC} ... "
+    rm -f $lost
+    ok=true
+    ./xor rebuild -j 3 rs_set.tmp rs_1.tmp rs_2.tmp rs_3.tmp rs_4.tmp 2>/dev/null || ok=false
+    for f in rs_1.tmp rs_2.tmp rs_3.tmp rs_4.tmp rs_set.tmp.1 rs_set.tmp.2; do
+        cmp -s rs_saved.tmp/$f $f || ok=false
+    done
+    if $ok; then
+        pass_test "rebuild after losing $lost"
+    else
+        fail_test "rebuild after losing $lost - rebuilt files differ"
+    fi
+    cp rs_saved.tmp/* .
+done
+
+rm -f rs_1.tmp rs_2.tmp rs_3.tmp
+test_error "Rebuild with too many losses" "cannot rebuild 3 missing files from 2 parity files" ./xor rebuild rs_set.tmp rs_1.tmp rs_2.tmp rs_3.tmp rs_4.tmp
+test_error "Invalid parity file count" "invalid parity file count" ./xor parity -m 0 rs_x.tmp rs_4.tmp rs_saved.tmp/rs_1.tmp
+
+rm -rf rs_?.tmp rs_set.tmp.? rs_saved.tmp
+
+echo
+echo -e "${BLUE}=== Keystream Tests ===${NC}"
+echo
+
+echo -ne "${YELLOW}Testing: keygen writes exactly SIZE bytes${NC} ... "
+if [ "$(./xor --keygen 1000001 | wc -c)" -eq 1000001 ] && [ "$(./xor --keygen 3K | wc -c)" -eq 3072 ] &&
+   [ "$(./xor --keygen 0 | wc -c)" -eq 0 ]; then
+    pass_test "keygen writes exactly SIZE bytes"
+else
+    fail_test "keygen writes exactly SIZE bytes - wrong length"
+fi
+
+echo -ne "${YELLOW}Testing: keygen seeds each run afresh${NC} ... "
+./xor --keygen 4096 > key_1.tmp
+./xor --keygen 4096 > key_2.tmp
+if ! cmp -s key_1.tmp key_2.tmp; then
+    pass_test "keygen seeds each run afresh"
+else
+    fail_test "keygen seeds each run afresh - two keys match"
+fi
+
+echo -ne "${YELLOW}Testing: threaded keygen to a file${NC} ... "
+./xor --keygen 5000000 -j 4 -o key_1.tmp
+./xor --keygen 3000000 -j 3 --kernel scalar > key_2.tmp
+if [ "$(wc -c < key_1.tmp)" -eq 5000000 ] && [ "$(wc -c < key_2.tmp)" -eq 3000000 ] &&
+   [ "$(head -c 65536 key_1.tmp | gzip -c | wc -c)" -gt 65536 ]; then
+    pass_test "threaded keygen to a file"
+else
+    fail_test "threaded keygen to a file - wrong length or compressible output"
+fi
+
+echo -ne "${YELLOW}Testing: keygen key round trip${NC} ... "
+head -c 1234567 /dev/urandom > key_data.tmp
+./xor --keygen "$(wc -c < key_data.tmp)" > key_1.tmp
+./xor -z key_data.tmp key_1.tmp > key_2.tmp
+if ./xor -z key_2.tmp key_1.tmp | cmp -s - key_data.tmp; then
+    pass_test "keygen key round trip"
+else
+    fail_test "keygen key round trip - decrypted file differs"
+fi
+
+echo -ne "${YELLOW}Testing: keygen splices into a pipe${NC} ... "
+./xor --keygen 1M --splice -p 2> key_2.tmp | cat > key_1.tmp
+if [ "$(wc -c < key_1.tmp)" -eq 1048576 ] && grep -q "vmspliced [1-9][0-9]* of 1048576 bytes" key_2.tmp; then
+    pass_test "keygen splices into a pipe"
+else
+    fail_test "keygen splices into a pipe - keystream was not vmspliced"
+fi
+
+test_error "Invalid keygen size" "invalid size: 12Q" ./xor --keygen 12Q
+test_error "Keygen with input files" "--keygen takes no input files" ./xor --keygen 10 key_data.tmp
+
+rm -f key_1.tmp key_2.tmp key_data.tmp
+
+echo
+echo -e "${BLUE}=== Keystream Operand Tests ===${NC}"
+echo
+
+# RFC 7539 section 2.4.2: the plaintext is encrypted from block 1 on
+printf '\x00\x01\x02\x03\x04\x05\x06\x07\x08\x09\x0a\x0b\x0c\x0d\x0e\x0f' > seed.tmp
+printf '\x10\x11\x12\x13\x14\x15\x16\x17\x18\x19\x1a\x1b\x1c\x1d\x1e\x1f' >> seed.tmp
+printf '\x00\x00\x00\x00\x00\x00\x00\x4a\x00\x00\x00\x00' >> seed.tmp
+{ head -c 64 /dev/zero
+  printf '%s' "Ladies and Gentlemen of the class of '99: If I could offer you only one tip for the future, sunscreen would be it."
+} > stream_in.tmp
+expected="6e2e359a2568f98041ba0728dd0d6981e97e7aec1d4360c20a27afccfd9fae0b"
+expected="${expected}f91b65c5524733ab8f593dabcd62b3571639d624e65152ab8f530c359f0861d8"
+expected="${expected}07ca0dbf500d6a6156a38e088a22b65e52bc514d16ccf806818ce91ab77937365af90bbf74a35be6b40b8eedf2785e42874d"
+
+for k in avx512 avx2 sse2 scalar; do
+    if ! ./xor --kernel "$k" --keygen 0 2>/dev/null; then
+        continue
+    fi
+    echo -ne "${YELLOW}Testing: RFC 7539 keystream ($k)${NC} ... "
+    actual=$(./xor -z --kernel "$k" stream_in.tmp chacha20:seed.tmp | tail -c +65 | od -An -v -tx1 | tr -d ' \n')
+    if [ "$actual" = "$expected" ]; then
+        pass_test "RFC 7539 keystream ($k)"
+    else
+        fail_test "RFC 7539 keystream ($k) - ciphertext differs"
+    fi
+done
+
+head -c 5000000 /dev/urandom > stream_in.tmp
+./xor -z stream_in.tmp chacha20:seed.tmp > stream_out.tmp
+
+echo -ne "${YELLOW}Testing: keystream operand round trip${NC} ... "
+if ./xor -z chacha20:seed.tmp stream_out.tmp | cmp -s - stream_in.tmp; then
+    pass_test "keystream operand round trip"
+else
+    fail_test "keystream operand round trip - decrypted file differs"
+fi
+
+echo -ne "${YELLOW}Testing: keystream kernels agree${NC} ... "
+ok=true
+for k in avx512 avx2 sse2 scalar; do
+    if ./xor --kernel "$k" --keygen 0 2>/dev/null; then
+        ./xor -z --kernel "$k" stream_in.tmp chacha20:seed.tmp | cmp -s - stream_out.tmp || ok=false
+    fi
+done
+if $ok; then
+    pass_test "keystream kernels agree"
+else
+    fail_test "keystream kernels agree - outputs differ"
+fi
+
+echo -ne "${YELLOW}Testing: keystream operand with -j and -i${NC} ... "
+./xor -z -j 3 -o stream_par.tmp stream_in.tmp chacha20:seed.tmp
+cp stream_in.tmp stream_inplace.tmp
+./xor -z -i stream_inplace.tmp chacha20:seed.tmp
+if cmp -s stream_par.tmp stream_out.tmp && cmp -s stream_inplace.tmp stream_out.tmp; then
+    pass_test "keystream operand with -j and -i"
+else
+    fail_test "keystream operand with -j and -i - output differs"
+fi
+
+test_error "Keystream operand with two files" "a chacha20: operand takes exactly one other file" ./xor stream_in.tmp stream_out.tmp chacha20:seed.tmp
+head -c 20 /dev/urandom > seed.tmp
+test_error "Short seed file" "seed file must hold a 32-byte key" ./xor stream_in.tmp chacha20:seed.tmp
+
+rm -f seed.tmp stream_in.tmp stream_out.tmp stream_par.tmp stream_inplace.tmp
+
+echo
+echo -e "${BLUE}=== Range Tests ===${NC}"
+echo
+head -c 3000000 /dev/urandom > range_a.tmp
+head -c 100000 /dev/urandom > range_b.tmp
+# Reference: cut the ranges out with dd, then XOR the whole pieces
+dd if=range_a.tmp of=range_a_cut.tmp bs=1000 skip=2500 count=8 2>/dev/null
+dd if=range_b.tmp of=range_b_cut.tmp bs=1000 skip=12 count=8 2>/dev/null
+./xor -z range_a_cut.tmp range_b_cut.tmp > range_expected.tmp
+
+echo -ne "${YELLOW}Testing: ranges of two files${NC} ... "
+if ./xor -z range_a.tmp@2500000:8000 range_b.tmp@12000:8000 | cmp -s - range_expected.tmp; then
+    pass_test "ranges of two files"
+else
+    fail_test "ranges of two files - output differs"
+fi
+
+echo -ne "${YELLOW}Testing: ranged stdin and -j${NC} ... "
+ok=true
+./xor -z -o range_out.tmp -- -@12000:8000 range_a.tmp@2500000:8000 < range_b.tmp
+cmp -s range_out.tmp range_expected.tmp || ok=false
+head -c 20000 range_b.tmp | ./xor -z -o range_out.tmp -- -@12000:8000 range_a.tmp@2500000:8000
+cmp -s range_out.tmp range_expected.tmp || ok=false
+./xor -z -j 3 -o range_out.tmp range_a.tmp@2500000:8000 range_b.tmp@12000:8000
+cmp -s range_out.tmp range_expected.tmp || ok=false
+if $ok; then
+    pass_test "ranged stdin and -j"
+else
+    fail_test "ranged stdin and -j - output differs"
+fi
+
+echo -ne "${YELLOW}Testing: in-place range${NC} ... "
+cp range_a.tmp range_inplace.tmp
+./xor -i range_inplace.tmp@2500000:8000 range_b.tmp@12000:8000
+dd if=range_inplace.tmp of=range_out.tmp bs=1000 skip=2500 count=8 2>/dev/null
+if [ "$(wc -c < range_inplace.tmp)" -eq 3000000 ] && cmp -s range_out.tmp range_expected.tmp &&
+   cmp -s -n 2500000 range_inplace.tmp range_a.tmp &&
+   cmp -s -i 2508000 range_inplace.tmp range_a.tmp; then
+    pass_test "in-place range"
+else
+    fail_test "in-place range - file1 changed outside the range"
+fi
+
+test_error "Malformed range" "first input file not found" ./xor range_a.tmp@1:2:3 range_b.tmp
+test_error "Same file beside a range" "cannot use the same file for two inputs" ./xor range_a.tmp@10 range_b.tmp range_b.tmp
+test_error "In place over the same file" "cannot use the same file for both inputs" ./xor -i range_inplace.tmp@1 range_inplace.tmp
+test_error "In place, read behind the write" "--in-place cannot read file1 where it is being rewritten" \
+    ./xor -i range_inplace.tmp@1000:8000 range_inplace.tmp@0:8000
+test_error "In place, overlapping ranges" "--in-place cannot read file1 where it is being rewritten" \
+    ./xor -i range_inplace.tmp@0:8000 range_inplace.tmp@4000:8000
+
+echo -ne "${YELLOW}Testing: in-place range from later in file1${NC} ... "
+cp range_a.tmp range_inplace.tmp
+./xor -i range_inplace.tmp@0:8000 range_inplace.tmp@2500000:8000
+dd if=range_a.tmp of=range_b_cut.tmp bs=1000 count=8 2>/dev/null
+./xor -z range_b_cut.tmp range_a_cut.tmp > range_expected.tmp
+if cmp -s -n 8000 range_inplace.tmp range_expected.tmp && cmp -s -i 8000 range_inplace.tmp range_a.tmp; then
+    pass_test "in-place range from later in file1"
+else
+    fail_test "in-place range from later in file1 - output differs"
+fi
+
+rm -f range_a.tmp range_b.tmp range_a_cut.tmp range_b_cut.tmp range_expected.tmp range_out.tmp range_inplace.tmp
+
+echo
+echo -e "${BLUE}=== Batch Tests ===${NC}"
+echo
+
+head -c 100000 /dev/urandom > batch_pad.tmp
+head -c 48 /dev/urandom > batch_key.tmp
+printf '# comment\n\n' > batch_manifest.tmp
+: > batch_keyed.tmp
+for i in 1 2 3 4 5 6; do
+    head -c $((i * 7000)) /dev/urandom > "batch_in$i.tmp"
+    echo "batch_in$i.tmp batch_pad.tmp batch_out$i.tmp" >> batch_manifest.tmp
+    echo "batch_in$i.tmp	batch_key.tmp	batch_kout$i.tmp" >> batch_keyed.tmp
+done
+echo "batch_pad.tmp@5000:300 batch_in6.tmp@100:200 batch_out7.tmp" >> batch_manifest.tmp
+
+echo -ne "${YELLOW}Testing: batch manifest${NC} ... "
+ok=true
+./xor -z -j 3 --batch batch_manifest.tmp
+for i in 1 2 3 4 5 6; do
+    ./xor -z "batch_in$i.tmp" batch_pad.tmp | cmp -s - "batch_out$i.tmp" || ok=false
+done
+./xor -z batch_pad.tmp@5000:300 batch_in6.tmp@100:200 | cmp -s - batch_out7.tmp || ok=false
+if $ok; then
+    pass_test "batch manifest"
+else
+    fail_test "batch manifest - output differs"
+fi
+
+echo -ne "${YELLOW}Testing: batch with --repeat-key${NC} ... "
+ok=true
+./xor --repeat-key --batch - < batch_keyed.tmp
+for i in 1 2 3 4 5 6; do
+    ./xor --repeat-key "batch_in$i.tmp" batch_key.tmp | cmp -s - "batch_kout$i.tmp" || ok=false
+done
+if $ok; then
+    pass_test "batch with --repeat-key"
+else
+    fail_test "batch with --repeat-key - output differs"
+fi
+
+echo "batch_in1.tmp batch_pad.tmp batch_done.tmp" > batch_manifest.tmp
+echo "batch_missing.tmp batch_pad.tmp batch_never.tmp" >> batch_manifest.tmp
+test_error "Batch job that cannot start" "line 2: cannot open batch_missing.tmp" ./xor --batch batch_manifest.tmp
+echo -ne "${YELLOW}Testing: other batch jobs still run${NC} ... "
+if ./xor batch_in1.tmp batch_pad.tmp | cmp -s - batch_done.tmp && [ ! -e batch_never.tmp ]; then
+    pass_test "other batch jobs still run"
+else
+    fail_test "other batch jobs still run - output missing"
+fi
+echo "batch_in1.tmp batch_pad.tmp" > batch_manifest.tmp
+test_error "Short manifest line" "manifest line 1: expected INPUT1 INPUT2 OUTPUT" ./xor --batch batch_manifest.tmp
+test_error "Batch with files" "--batch takes its files from the manifest" ./xor --batch batch_manifest.tmp batch_in1.tmp
+
+rm -f batch_*.tmp
+
+echo
+echo -e "${BLUE}=== Recursive Tests ===${NC}"
+echo
+
+rm -rf tree_src.tmp tree_enc.tmp tree_dec.tmp tree_restart.tmp
+mkdir -p tree_src.tmp/a/b tree_src.tmp/c
+head -c 30000 /dev/urandom > tree_src.tmp/a/b/one
+head -c 1234 /dev/urandom > tree_src.tmp/a/two
+head -c 70000 /dev/urandom > tree_src.tmp/c/three
+printf 'ends in zeros\0\0\0' > tree_src.tmp/four
+: > tree_src.tmp/empty
+head -c 200000 /dev/urandom > tree_key.tmp
+
+echo -ne "${YELLOW}Testing: recursive round trip${NC} ... "
+./xor -r -j 3 tree_src.tmp tree_key.tmp tree_enc.tmp
+./xor -r tree_enc.tmp tree_key.tmp tree_dec.tmp
+if diff -r tree_src.tmp tree_dec.tmp >/dev/null && ! cmp -s tree_src.tmp/c/three tree_enc.tmp/c/three; then
+    pass_test "recursive round trip"
+else
+    fail_test "recursive round trip - trees differ"
+fi
+
+# Files take consecutive key ranges in byte order of their paths
+echo -ne "${YELLOW}Testing: continued key offsets${NC} ... "
+ok=true
+offset=0
+for f in a/b/one a/two c/three empty four; do
+    size=$(wc -c < "tree_src.tmp/$f")
+    if [ "$size" -gt 0 ]; then
+        ./xor -z "tree_src.tmp/$f" "tree_key.tmp@$offset:$size" | cmp -s - "tree_enc.tmp/$f" || ok=false
+    fi
+    offset=$((offset + size))
+done
+if $ok; then
+    pass_test "continued key offsets"
+else
+    fail_test "continued key offsets - output differs"
+fi
+
+echo -ne "${YELLOW}Testing: restarted key offsets${NC} ... "
+./xor -r --key-offset=restart tree_src.tmp tree_key.tmp tree_restart.tmp
+if ./xor -z tree_src.tmp/c/three tree_key.tmp@0:70000 | cmp -s - tree_restart.tmp/c/three &&
+   ./xor -z tree_src.tmp/a/two tree_key.tmp@0:1234 | cmp -s - tree_restart.tmp/a/two; then
+    pass_test "restarted key offsets"
+else
+    fail_test "restarted key offsets - output differs"
+fi
+
+test_error "Key too short for the tree" "key is too short" ./xor -r tree_src.tmp tree_src.tmp/a/two tree_short.tmp
+test_error "Recursive into the source" "cannot use the source directory as the output" ./xor -r tree_src.tmp tree_key.tmp tree_src.tmp
+test_error "Bad key offset mode" "--key-offset must be continue or restart" ./xor -r --key-offset=middle tree_src.tmp tree_key.tmp tree_out.tmp
+
+rm -rf tree_src.tmp tree_enc.tmp tree_dec.tmp tree_restart.tmp tree_short.tmp tree_key.tmp
+
+echo
+echo -e "${BLUE}=== Library Tests ===${NC}"
+echo
+
+# A client of libxor.a checked against the command on the same data
+make -s libxor.a
+cat > lib_client.tmp.c <<'EOF'
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "xor.h"
+
+int main(int argc, char **argv) {
+    if (argc > 1) {
+        return xor_use_kernel(argv[1]) == XOR_OK ? 0 : 1;
+    }
+    static unsigned char a[100000], b[70000], out[100000];
+    if (fread(a, 1, sizeof(a), stdin) != sizeof(a) || fread(b, 1, sizeof(b), stdin) != sizeof(b)) {
+        return 2;
+    }
+    unsigned char direct[70000];
+    if (xor_buffers(direct, a, b, sizeof(b)) != xor_data_length(direct, sizeof(b))) {
+        return 3;
+    }
+    // Updates of uneven sizes, with b running out part way through one
+    xor_stream *stream;
+    if (xor_stream_init(&stream, NULL) != XOR_OK) {
+        return 4;
+    }
+    size_t done = 0, step = 777;
+    while (done < sizeof(a)) {
+        size_t n = (sizeof(a) - done < step) ? sizeof(a) - done : step;
+        size_t with_b = (done < sizeof(b)) ? ((sizeof(b) - done < n) ? sizeof(b) - done : n) : 0;
+        xor_stream_update(stream, out + done, a + done, b + done, with_b);
+        xor_stream_update(stream, out + done + with_b, a + done + with_b, NULL, n - with_b);
+        done += n;
+        step = step * 3 % 40000 + 1;
+    }
+    uint64_t length, data_end;
+    xor_stream_finish(stream, &length, &data_end);
+    if (length != sizeof(a) || memcmp(out, direct, sizeof(b)) != 0) {
+        return 5;
+    }
+    if (xor_stream_update(NULL, out, a, b, 1) != XOR_ERR_ARGUMENT ||
+        xor_key_new(NULL, a, 0) != XOR_ERR_ARGUMENT) {
+        return 6;
+    }
+    fwrite(out, 1, (size_t)data_end, stdout);
+    return 0;
+}
+EOF
+echo -ne "${YELLOW}Testing: library build${NC} ... "
+if ${CC:-gcc} -std=c99 -Wall -Wextra -Werror -I. -o lib_client.tmp lib_client.tmp.c libxor.a -pthread 2>lib_build.tmp; then
+    pass_test "library build"
+else
+    fail_test "library build - $(head -1 lib_build.tmp)"
+fi
+
+head -c 100000 /dev/urandom > lib_a.tmp
+head -c 70000 /dev/urandom > lib_b.tmp
+echo -ne "${YELLOW}Testing: library stream matches the command${NC} ... "
+if cat lib_a.tmp lib_b.tmp | ./lib_client.tmp > lib_out.tmp && ./xor lib_a.tmp lib_b.tmp | cmp -s - lib_out.tmp; then
+    pass_test "library stream matches the command"
+else
+    fail_test "library stream matches the command - output differs"
+fi
+
+echo -ne "${YELLOW}Testing: library rejects an unknown kernel${NC} ... "
+if ./lib_client.tmp scalar && ! ./lib_client.tmp bogus; then
+    pass_test "library rejects an unknown kernel"
+else
+    fail_test "library rejects an unknown kernel - status differs"
+fi
+
+rm -f lib_client.tmp lib_client.tmp.c lib_build.tmp lib_a.tmp lib_b.tmp lib_out.tmp
+
+echo
+echo -e "${BLUE}=== Stats Tests ===${NC}"
+echo
+
+printf 'stats data\0\0\0\0' > stats_a.tmp
+printf 'xyz' > stats_b.tmp
+echo -ne "${YELLOW}Testing: stats byte counts${NC} ... "
+./xor --stats=json stats_a.tmp stats_b.tmp 2> stats_out.tmp > stats_result.tmp
+stats=$(tail -1 stats_out.tmp)
+if [[ "$stats" == "{"*"}" ]] &&
+   [[ "$stats" == *'{"name":"stats_a.tmp","bytes_read":14},{"name":"stats_b.tmp","bytes_read":3}'* ]] &&
+   [[ "$stats" == *'"bytes_processed":14,"bytes_written":10,"bytes_stripped":4'* ]] &&
+   [ "$(wc -c < stats_result.tmp)" -eq 10 ]; then
+    pass_test "stats byte counts"
+else
+    fail_test "stats byte counts - got $stats"
+fi
+
+# Every engine reports its name and all the timing fields
+for engine in mmap stdio pipeline; do
+    echo -ne "${YELLOW}Testing: stats from the $engine engine${NC} ... "
+    stats=$(head -c 300000 /dev/urandom | ./xor --stats --io "$engine" - stats_b.tmp 2>&1 >/dev/null)
+    ok=true
+    for field in '"engine":"'"$engine"'"' '"kernel":"' '"bytes_read":300000' '"wall_seconds":' \
+                 '"read_wait_seconds":' '"compute_seconds":' '"write_wait_seconds":' \
+                 '"throughput_bytes_per_second":' '"peak_rss_kb":'; do
+        [[ "$stats" == *"$field"* ]] || ok=false
+    done
+    if $ok; then
+        pass_test "stats from the $engine engine"
+    else
+        fail_test "stats from the $engine engine - got $stats"
+    fi
+done
+
+head -c 3000000 /dev/urandom > stats_big.tmp
+echo -ne "${YELLOW}Testing: stats from threaded workers${NC} ... "
+stats=$(./xor --stats -j 2 -o stats_result.tmp stats_big.tmp stats_b.tmp 2>&1)
+if [[ "$stats" == *'"engine":"parallel","threads":2'* ]] &&
+   [[ "$stats" == *'{"name":"stats_big.tmp","bytes_read":3000000},{"name":"stats_b.tmp","bytes_read":3}'* ]] &&
+   [[ "$stats" == *'"bytes_processed":3000000,"bytes_written":3000000'* ]]; then
+    pass_test "stats from threaded workers"
+else
+    fail_test "stats from threaded workers - got $stats"
+fi
+
+# Workers skip holes and the zero tail, so they read less than the file size
+echo -ne "${YELLOW}Testing: stats count bytes actually read${NC} ... "
+head -c 1048576 /dev/urandom > stats_sparse.tmp
+truncate -s 9437184 stats_sparse.tmp
+stats=$(./xor --stats -o stats_result.tmp stats_sparse.tmp stats_big.tmp 2>&1)
+read_bytes=$(echo "$stats" | sed -n 's/.*"name":"stats_sparse.tmp","bytes_read":\([0-9]*\).*/\1/p')
+if [ -n "$read_bytes" ] && [ "$read_bytes" -ge 1048576 ] && [ "$read_bytes" -le 3000000 ] &&
+   [[ "$stats" == *'"name":"stats_big.tmp","bytes_read":3000000'* ]]; then
+    pass_test "stats count bytes actually read"
+else
+    fail_test "stats count bytes actually read - got $stats"
+fi
+
+echo -ne "${YELLOW}Testing: stats escape file names${NC} ... "
+cp stats_b.tmp 'stats_"q".tmp'
+stats=$(./xor --stats stats_a.tmp 'stats_"q".tmp' 2>&1 >/dev/null)
+if [[ "$stats" == *'"name":"stats_\"q\".tmp"'* ]]; then
+    pass_test "stats escape file names"
+else
+    fail_test "stats escape file names - got $stats"
+fi
+
+test_error "Unknown stats format" "unknown stats format: xml" ./xor --stats=xml stats_a.tmp stats_b.tmp
+test_error "Stats with --keygen" "--stats is only for XORing files" ./xor --stats --keygen 16
+
+rm -f stats_a.tmp stats_b.tmp stats_big.tmp stats_sparse.tmp stats_out.tmp stats_result.tmp 'stats_"q".tmp'
 
 # Summary
 echo
@@ -1,5 +1,5 @@
 /*
- * XOR Tool - XOR two files together
+ * XOR Tool - XOR two or more files together
  * 
  * A Unix-style command-line utility for XOR operations on files.
  * Supports streaming I/O, progress reporting, and optional zero preservation.
@@ -12,12 +12,95 @@
 #include <getopt.h>
 #include <signal.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
 #include <errno.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <dirent.h>
+
+#include "xor.h"
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<sys/random.h>)
+#include <sys/random.h>
+#define XOR_GETRANDOM 1
+#endif
+#endif
+#ifndef XOR_GETRANDOM
+#define XOR_GETRANDOM 0
+#endif
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define XOR_X86 1
+#include <immintrin.h>  // _mm_pause()
+#else
+#define XOR_X86 0
+#endif
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#ifdef __NR_io_uring_setup
+#define XOR_URING 1
+#endif
+#endif
+#endif
+#ifndef XOR_URING
+#define XOR_URING 0
+#endif
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#ifdef SYS_getdents64
+#define XOR_GETDENTS 1
+#endif
+#endif
+#ifndef XOR_GETDENTS
+#define XOR_GETDENTS 0
+#endif
+
+#if defined(__linux__) && defined(SPLICE_F_MOVE) && defined(F_SETPIPE_SZ)
+#define XOR_SPLICE 1
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+#else
+#define XOR_SPLICE 0
+#endif
 
 #define VERSION "1.0.0"
 #define CHUNK_SIZE 65536  // 64KB chunks
 #define PROG_NAME "xor"
+#define MAP_WINDOW (16 * 1024 * 1024)  // Bytes of an input mapped at once
+#define PIPELINE_CHUNK (CHUNK_SIZE * 4)  // Bytes per pipeline ring slot
+#define PIPELINE_SLOTS 8                 // Slots per pipeline ring
+#define PIPELINE_ALIGN 4096              // Alignment of rings and slot buffers
+#define PARALLEL_CHUNK (CHUNK_SIZE * 16)  // Bytes per parallel work item
+#define MAX_INPUTS 256  // Most files one run can XOR together
+#define MAX_JOBS 1024   // Most threads -j accepts
+#define URING_CHUNK (CHUNK_SIZE * 4)  // Bytes per io_uring buffer slot
+#define URING_DEPTH 8                 // Slots, and reads in flight, per input
+#define URING_WRITES 8                // Output writes in flight
+#define URING_ENTRIES 32              // Submission queue size
+#define URING_QUEUE (URING_DEPTH * 4) // Output runs waiting to be written
+#define SPLICE_PIPE_SIZE (1024 * 1024)  // Pipe size requested for vmsplice
+#define COPY_CHUNK (1024 * 1024 * 1024)  // Largest single kernel copy
+#define SPARSE_BLOCK 4096                // Granularity of holes left in the output
+#define PARITY_MAGIC "XORPRTY1"
+#define PARITY_FIXED_HEADER 24           // Header bytes before the lengths
+#define PARITY_ALIGN 4096                // Parity data starts on this boundary
+#define MAX_PARITY 32                    // Most parity files in one set
+#define DIRENT_BUFFER 32768              // getdents64 buffer for -r
+#define PROGRESS_INTERVAL (CHUNK_SIZE * 16)  // Report every 1MB
 
 // Exit codes
 #define EXIT_SUCCESS 0
@@ -29,16 +112,381 @@ static volatile sig_atomic_t interrupted = 0;
 static bool show_progress = false;
 static bool preserve_zeros = false;
 
+// I/O engines
+typedef enum {
+    IO_MMAP,      // Map regular files, stdio for everything else
+    IO_STDIO,     // Buffered fread for all inputs
+    IO_PIPELINE,  // Reader, XOR and writer threads joined by rings
+    IO_URING      // Asynchronous reads and writes through io_uring
+} io_engine;
+
+static const char *const io_engine_names[] = { "mmap", "stdio", "pipeline", "uring" };
+static io_engine io_mode = IO_MMAP;
+static const char *output_file = NULL;
+static long jobs = 1;
+static bool use_splice = false;
+static bool in_place = false;
+
+// An input operand. Regular files are read through a sliding read-only
+// mapping of MAP_WINDOW bytes; pipes, FIFOs, character devices and
+// terminals go through stdio. A mapped file that is truncated while being
+// read raises SIGBUS, as with any mmap reader.
+typedef struct {
+    FILE *stream;
+    int fd;                  // Mapped descriptor, or -1 for stdio
+    uint64_t size;
+    uint64_t pos;
+    unsigned char *map;
+    uint64_t map_offset;
+    size_t map_len;
+    uint64_t limit;          // Bytes left to read through stdio
+    uint64_t consumed;       // Bytes taken from the input so far
+} input_stream;
+
+// The part of an operand taken by FILE@OFFSET[:LENGTH]
+typedef struct {
+    uint64_t offset;
+    uint64_t length;         // UINT64_MAX: to the end
+} byte_range;
+
+// vmsplice output to a pipe
+typedef struct {
+    int fd;
+    size_t pipe_size;
+    uint64_t spliced;          // Bytes handed to the pipe so far
+    uint64_t vmspliced;        // Of those, bytes that went by vmsplice
+    unsigned char *buffers;    // count ring buffers, then a private one
+    unsigned char *private_buffer;
+    uint64_t *marks;           // spliced after each buffer's last use
+    size_t count;
+    uint64_t next;
+} splice_output;
+
+// Streaming output state. Runs of zero bytes are held back as a count
+// rather than buffered, and only written once a later nonzero byte shows
+// they are not trailing, so memory use stays constant. A regular output
+// file skips the holdback: everything is written and the file is then
+// truncated back to the last nonzero byte.
+typedef struct {
+    FILE *stream;
+    uint64_t pending_zeros;
+    uint64_t bytes_written;
+    splice_output *splice;     // Set when output is vmspliced to a pipe
+    int truncate_fd;           // Output file to truncate at the end, or -1
+    uint64_t data_end;         // End of the last nonzero byte written
+} output_state;
+
+static const unsigned char zero_chunk[CHUNK_SIZE];
+
+// Threaded pipeline. Each stage pair shares a single-producer,
+// single-consumer ring of preallocated, page-aligned chunk buffers. The
+// head and tail counters only ever grow and sit on separate cache lines.
+typedef struct {
+    unsigned char *data;
+    size_t len;        // Bytes in data; 0 marks end of stream
+    size_t data_len;   // Output slots: length up to the last nonzero byte
+} pipeline_slot;
+
+typedef struct {
+    uint64_t head;     // Slots published, written by the producer only
+    char head_pad[64 - sizeof(uint64_t)];
+    uint64_t tail;     // Slots released, written by the consumer only
+    char tail_pad[64 - sizeof(uint64_t)];
+    pipeline_slot slots[PIPELINE_SLOTS];
+} spsc_ring;
+
+typedef struct {
+    input_stream *in;
+    spsc_ring *ring;
+    output_state *out;
+} pipeline_stage;
+
+// Parallel file-to-file job shared by all workers
+typedef struct {
+    int fd1;
+    int fd2;
+    int out_fd;
+    uint64_t size1;
+    uint64_t size2;
+    uint64_t total;
+    uint64_t next_chunk;   // Next PARALLEL_CHUNK index to claim
+    uint64_t bytes_done;
+    uint64_t bytes_read[2];  // Bytes read from each input, holes skipped
+    unsigned char *out_map;  // Shared mapping of the output, or NULL to pwrite
+    bool sparse;             // An input has holes; skip them and keep holes in the output
+} parallel_job;
+
+typedef struct {
+    parallel_job *job;
+    pthread_t thread;
+    uint64_t data_end;     // End of the last nonzero byte this worker wrote
+} parallel_worker;
+
+#if XOR_URING
+// Registered buffer regions: one per input, the output, and a zero run
+#define URING_OUTPUT_REGION 2
+#define URING_ZERO_REGION 3
+#define URING_WRITE (1ULL << 32)  // user_data flag marking a write
+
+typedef struct {
+    int fd;
+    unsigned to_submit;
+    void *sq_ring;
+    void *cq_ring;
+    size_t sq_ring_size;
+    size_t cq_ring_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    unsigned *sq_tail;
+    unsigned *sq_array;
+    unsigned sq_mask;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+} uring;
+
+typedef struct {
+    int fd;
+    bool seekable;
+    uint64_t base;         // Offset of the first byte, when seekable
+    uint64_t size;         // Bytes from base on, or UINT64_MAX until EOF
+    uint64_t next_read;    // Next chunk to start reading
+    uint64_t end_chunk;    // First chunk past the end, once known
+    unsigned in_flight;
+    unsigned char *buffers;
+    uint64_t slot_chunk[URING_DEPTH];
+    size_t want[URING_DEPTH];
+    size_t filled[URING_DEPTH];
+    bool ready[URING_DEPTH];
+    input_stream *stream;  // Counts the bytes read
+} uring_input;
+
+typedef struct {
+    const unsigned char *data;  // NULL for a run of zeros
+    uint64_t len;
+    uint64_t offset;
+    int slot;                   // Output slot to free when written, or -1
+} uring_write;
+
+typedef struct {
+    int fd;
+    bool seekable;
+    uint64_t next_offset;
+    unsigned char *buffers;
+    const unsigned char *zeros;
+    bool busy[URING_DEPTH];
+    uring_write queue[URING_QUEUE];
+    unsigned queue_head;
+    unsigned queue_len;
+    uring_write active[URING_WRITES];
+    unsigned in_flight;
+} uring_output;
+#endif
+
+// Parity file header, see write_parity_header()
+typedef struct {
+    uint32_t data_count;
+    uint32_t parity_count;   // Parity files in the set
+    uint32_t parity_index;   // Which of them this one is
+    uint64_t *lengths;       // Original length of each data file
+    uint64_t data_offset;    // Where the parity bytes start
+    uint64_t length;         // Parity bytes: the longest data length
+} parity_header;
+
+// Multi-input stripe job for parity and rebuild. Input k is in_lengths[k]
+// bytes at in_offsets[k] of in_fds[k]. Output o is the GF(2^8) sum of
+// every input times its coefficient in row o of coefs, written to
+// out_fds[o] at out_offsets[o] for out_lengths[o] bytes. A row of all
+// ones is a plain XOR.
+typedef struct {
+    int *in_fds;
+    uint64_t *in_offsets;
+    uint64_t *in_lengths;
+    size_t in_count;
+    int *out_fds;
+    uint64_t *out_offsets;
+    uint64_t *out_lengths;
+    size_t out_count;
+    unsigned char *coefs;    // out_count rows of in_count coefficients
+    unsigned char *tables;   // Multiply tables for coefs, see xor_gf_tables()
+    bool *xor_rows;          // Rows that are all ones
+    uint64_t length;         // The longest output
+    uint64_t next_chunk;
+    uint64_t bytes_done;
+} stripe_job;
+
+// --keygen: threads claim PARALLEL_CHUNK ranges of size bytes, written at
+// base onwards
+typedef struct {
+    const xor_keystream *ks;
+    int fd;
+    uint64_t base;
+    uint64_t size;
+    uint64_t next_chunk;
+    uint64_t bytes_done;
+} keygen_job;
+
+// The --repeat-key key, or a chacha20:SEEDFILE keystream
+static xor_key *cyclic_key = NULL;
+
+// An input of a --batch job: a range of an open file, or of a mapping
+// shared by every job that names the same operand
+typedef struct {
+    int fd;                     // -1 once mapped
+    dev_t dev;
+    ino_t ino;
+    uint64_t offset;            // Start of the range in the file
+    uint64_t size;              // Bytes in the range
+    unsigned char *map;         // Whole-page mapping holding the range
+    size_t map_len;
+    const unsigned char *data;  // The range within map, when mapped
+    xor_key *key;               // The range expanded as a --repeat-key key
+    bool ok;
+    char error[256];            // Why it could not be opened, unless ok
+} batch_input;
+
+// One line of a --batch manifest, or one file under -r
+typedef struct {
+    const char *operands[3];    // input1, input2, output
+    size_t line;                // 0 under -r
+    batch_input *shared[2];     // Shared input, or NULL to open per job
+    byte_range range2;          // The part of input2 this job uses
+} batch_entry;
+
+// Each batch worker owns a deque of job indices, packed as head << 32 |
+// tail so that both ends move with one compare-and-swap. The owner takes
+// from the head and idle workers steal from the tail.
+typedef struct {
+    uint64_t range;
+    char pad[64 - sizeof(uint64_t)];
+} batch_deque;
+
+typedef struct {
+    batch_entry *entries;
+    size_t count;
+    bool keyed;                 // input2 is a --repeat-key key
+    bool mirror;                // Outputs keep input1's length, zeros and all
+    batch_deque *deques;
+    size_t workers;
+    uint64_t jobs_done;
+    uint64_t jobs_failed;
+    uint64_t bytes_done;
+} batch_job;
+
+typedef struct {
+    batch_job *batch;
+    size_t index;
+    pthread_t thread;
+} batch_worker;
+
+// -r: a file found under SRC_DIR
+typedef struct {
+    char *path;                 // Relative to SRC_DIR
+    uint64_t size;
+} tree_file;
+
+// -r: directories waiting to be read, shared by the walker threads
+typedef struct {
+    int src_fd;
+    int out_fd;
+    dev_t out_dev;              // OUT_DIR, skipped if it is inside SRC_DIR
+    ino_t out_ino;
+    char **dirs;                // Relative to SRC_DIR; "" is SRC_DIR itself
+    size_t dir_count;
+    size_t dir_capacity;
+    size_t active;              // Directories being read
+    uint64_t failures;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+} tree_walk;
+
+typedef struct {
+    tree_walk *walk;
+    tree_file *files;
+    size_t count;
+    size_t capacity;
+    pthread_t thread;
+} tree_walker;
+
+// --stats: what a run of the XOR engines did, printed as JSON on stderr
+// when it ends. Phase times are summed over every thread that reads, XORs
+// or writes: read_ns is time blocked in read calls, write_ns time blocked
+// in write calls, and compute_ns time in the XOR kernels. Page faults on
+// mapped inputs happen in the kernels, so they count as compute.
+typedef struct {
+    struct timespec start;
+    const char *const *names;
+    uint64_t input_bytes[MAX_INPUTS];  // Read from each input; holes are skipped, not read
+    size_t input_count;
+    uint64_t bytes_processed;
+    uint64_t bytes_written;
+    const char *engine;
+    long threads;
+    uint64_t read_ns;
+    uint64_t compute_ns;
+    uint64_t write_ns;
+} run_stats;
+
+static bool collect_stats = false;
+static run_stats stats;
+
 // Function prototypes
 static void signal_handler(int signum);
 static void setup_signal_handling(void);
 static void die(const char *message, int exit_code);
 static void progress(const char *message);
-static FILE *open_input_stream(const char *filename);
-static void xor_files(const char *file1, const char *file2);
+static uint64_t stats_clock(void);
+static void stats_add(uint64_t *phase, uint64_t started);
+static void report_stats(void);
+static void select_kernel(const char *name);
+static long parse_jobs(const char *arg);
+static size_t parse_parity_count(const char *arg);
+static uint64_t parse_size(const char *arg);
+static char *operand_path(const char *operand, byte_range *range);
+static bool is_ranged(const byte_range *range);
+static bool ranges_clash(const byte_range *range1, const byte_range *range2, uint64_t size);
+static size_t read_full(int fd, unsigned char *buf, size_t len);
+static io_engine parse_io_engine(const char *name);
+static void open_input_stream(input_stream *in, const char *filename);
+static size_t read_input(input_stream *in, unsigned char *buf, size_t len,
+                         const unsigned char **data);
+static bool input_error(const input_stream *in);
+static void close_input_stream(input_stream *in);
+static void load_repeat_key(const char *filename);
+static void load_stream_key(const char *filename);
+static void write_output(output_state *out, const unsigned char *data, size_t len);
+static void write_zeros(output_state *out, uint64_t count);
+static void emit_chunk(output_state *out, const unsigned char *data, size_t len, size_t data_len);
+static size_t xor_chunk(unsigned char *dst, const unsigned char *data1, size_t len1,
+                        const unsigned char *data2, size_t len2);
+static xor_stream *open_xor_stream(const xor_key *key);
+static void close_xor_stream(xor_stream *xs);
+static size_t stream_chunk(xor_stream *xs, unsigned char *dst, const unsigned char *data1, size_t len1,
+                           const unsigned char *data2, size_t len2);
+static uint64_t xor_serial(input_stream *in1, input_stream *in2, output_state *out);
+static uint64_t xor_repeat_serial(input_stream *in, output_state *out);
+static uint64_t xor_multi_serial(input_stream *inputs, size_t count, output_state *out);
+static uint64_t xor_pipeline(input_stream *in1, input_stream *in2, output_state *out);
+static uint64_t find_data_end(int fd, uint64_t start, uint64_t end);
+static void copy_range(int in_fd, uint64_t offset, int out_fd, off_t *out_off, uint64_t len);
+static uint64_t xor_parallel(const char *file1, uint64_t size1, const char *file2,
+                             uint64_t size2, int out_fd, uint64_t bytes_read[2]);
+static bool xor_uring(input_stream *in1, input_stream *in2, output_state *out,
+                      uint64_t *bytes_processed);
+static void xor_files(const char *const *files, const struct stat *sts, size_t count);
+static void xor_in_place(const char *file1, const struct stat *st1,
+                         const char *file2, const struct stat *st2);
+static void parity_command(const char *parity_file, const char *const *data_files, size_t count,
+                           size_t parity_count);
+static void rebuild_command(const char *parity_file, const char *const *data_files, size_t count);
+static void keygen_command(uint64_t size);
+static void batch_command(const char *manifest, bool keyed);
+static void recursive_command(const char *src_dir, const char *key_operand, const char *out_dir,
+                              bool keyed, bool restart);
 static void show_help(void);
 static void show_version(void);
-static void validate_file_access(const char *filename, const char *description);
+static void validate_file_access(const char *filename, const char *description, struct stat *st);
 static bool is_same_file(const char *file1, const char *file2);
 
 static void signal_handler(int signum) {
@@ -75,159 +523,3632 @@ static void die(const char *message, int exit_code) {
     exit(exit_code);
 }
 
-static void progress(const char *message) {
-    if (show_progress) {
-        fprintf(stderr, "%s: %s\n", PROG_NAME, message);
+static void progress(const char *message) {
+    if (show_progress) {
+        fprintf(stderr, "%s: %s\n", PROG_NAME, message);
+    }
+}
+
+// Monotonic nanoseconds for the --stats phase timers, or 0 when they are off
+static uint64_t stats_clock(void) {
+    if (!collect_stats) {
+        return 0;
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// Charge the time since started to a phase; safe from any thread
+static void stats_add(uint64_t *phase, uint64_t started) {
+    if (collect_stats) {
+        __atomic_fetch_add(phase, stats_clock() - started, __ATOMIC_RELAXED);
+    }
+}
+
+static void print_json_string(FILE *f, const char *s) {
+    fputc('"', f);
+    for (; *s != '\0'; s++) {
+        unsigned char ch = (unsigned char)*s;
+        if (ch == '"' || ch == '\\') {
+            fprintf(f, "\\%c", ch);
+        } else if (ch < 0x20) {
+            fprintf(f, "\\u%04x", ch);
+        } else {
+            fputc(ch, f);
+        }
+    }
+    fputc('"', f);
+}
+
+// The --stats report: one line of JSON on stderr
+static void report_stats(void) {
+    if (!collect_stats) {
+        return;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double wall = (double)(now.tv_sec - stats.start.tv_sec) +
+                  (double)(now.tv_nsec - stats.start.tv_nsec) / 1e9;
+    struct rusage usage;
+    long peak_rss_kb = 0;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef __APPLE__
+        peak_rss_kb = usage.ru_maxrss / 1024;  // Bytes on macOS
+#else
+        peak_rss_kb = usage.ru_maxrss;
+#endif
+    }
+    uint64_t stripped = (stats.bytes_processed > stats.bytes_written)
+        ? stats.bytes_processed - stats.bytes_written : 0;
+    
+    fprintf(stderr, "{\"version\":\"%s\",\"kernel\":\"%s\",\"engine\":\"%s\",\"threads\":%ld,\"inputs\":[",
+            VERSION, xor_kernel_name(), stats.engine, stats.threads);
+    for (size_t k = 0; k < stats.input_count; k++) {
+        fprintf(stderr, "%s{\"name\":", k > 0 ? "," : "");
+        print_json_string(stderr, stats.names[k]);
+        fprintf(stderr, ",\"bytes_read\":%" PRIu64 "}", stats.input_bytes[k]);
+    }
+    fprintf(stderr, "],\"bytes_processed\":%" PRIu64 ",\"bytes_written\":%" PRIu64
+            ",\"bytes_stripped\":%" PRIu64, stats.bytes_processed, stats.bytes_written, stripped);
+    fprintf(stderr, ",\"wall_seconds\":%.6f,\"read_wait_seconds\":%.6f,\"compute_seconds\":%.6f"
+            ",\"write_wait_seconds\":%.6f,\"throughput_bytes_per_second\":%.0f,\"peak_rss_kb\":%ld}\n",
+            wall, (double)stats.read_ns / 1e9, (double)stats.compute_ns / 1e9, (double)stats.write_ns / 1e9,
+            wall > 0 ? (double)stats.bytes_processed / wall : 0.0, peak_rss_kb);
+}
+
+// --kernel NAME, or the fastest kernel when name is NULL
+static void select_kernel(const char *name) {
+    int status = xor_use_kernel(name);
+    if (status != XOR_OK) {
+        char error_msg[256];
+        snprintf(error_msg, sizeof(error_msg), "%s: %s", xor_strerror(status), name);
+        die(error_msg, EXIT_USAGE);
+    }
+}
+
+// Worker thread count; 0 means one per online CPU
+static long parse_jobs(const char *arg) {
+    char *end;
+    errno = 0;
+    long n = strtol(arg, &end, 10);
+    if (errno != 0 || end == arg || *end != '\0' || n < 0 || n > MAX_JOBS) {
+        char error_msg[256];
+        snprintf(error_msg, sizeof(error_msg), "invalid job count: %s", arg);
+        die(error_msg, EXIT_USAGE);
+    }
+    if (n == 0) {
+        n = sysconf(_SC_NPROCESSORS_ONLN);
+        if (n < 1) {
+            n = 1;
+        }
+    }
+    return n;
+}
+
+static size_t parse_parity_count(const char *arg) {
+    char *end;
+    errno = 0;
+    long n = strtol(arg, &end, 10);
+    if (errno != 0 || end == arg || *end != '\0' || n < 1 || n > MAX_PARITY) {
+        char error_msg[256];
+        snprintf(error_msg, sizeof(error_msg), "invalid parity file count: %s", arg);
+        die(error_msg, EXIT_USAGE);
+    }
+    return (size_t)n;
+}
+
+// Read a byte count, optionally with a K, M, G or T (binary) suffix, from
+// the start of s, leaving *end just past it
+static bool scan_size(const char *s, const char **end, uint64_t *value) {
+    char *p;
+    if (*s < '0' || *s > '9') {
+        return false;
+    }
+    errno = 0;
+    unsigned long long n = strtoull(s, &p, 10);
+    int shift = 0;
+    switch (*p) {
+        case 'K': case 'k': shift = 10; p++; break;
+        case 'M': case 'm': shift = 20; p++; break;
+        case 'G': case 'g': shift = 30; p++; break;
+        case 'T': case 't': shift = 40; p++; break;
+        default: break;
+    }
+    if (errno != 0 || n > (UINT64_MAX >> shift) || (n << shift) > (uint64_t)INT64_MAX) {
+        return false;
+    }
+    *end = p;
+    *value = (uint64_t)n << shift;
+    return true;
+}
+
+static uint64_t parse_size(const char *arg) {
+    const char *end;
+    uint64_t size;
+    if (!scan_size(arg, &end, &size) || *end != '\0') {
+        char error_msg[256];
+        snprintf(error_msg, sizeof(error_msg), "invalid size: %s", arg);
+        die(error_msg, EXIT_USAGE);
+    }
+    return size;
+}
+
+// An operand is a path, optionally followed by @OFFSET or @OFFSET:LENGTH
+// to take just that byte range of it. A path that exists as given is
+// never split. Returns the path, which the caller frees.
+static char *operand_path(const char *operand, byte_range *range) {
+    range->offset = 0;
+    range->length = UINT64_MAX;
+    const char *at = strrchr(operand, '@');
+    const char *end;
+    byte_range parsed = { 0, UINT64_MAX };
+    if (at != NULL && at != operand && strcmp(operand, "-") != 0 && access(operand, F_OK) != 0 &&
+        scan_size(at + 1, &end, &parsed.offset) &&
+        (*end == '\0' || (*end == ':' && scan_size(end + 1, &end, &parsed.length) && *end == '\0'))) {
+        *range = parsed;
+    } else {
+        at = operand + strlen(operand);
+    }
+    
+    char *path = malloc((size_t)(at - operand) + 1);
+    if (path == NULL) {
+        die("memory allocation failed", EXIT_ERROR);
+    }
+    memcpy(path, operand, (size_t)(at - operand));
+    path[at - operand] = '\0';
+    return path;
+}
+
+static bool is_ranged(const byte_range *range) {
+    return range->offset != 0 || range->length != UINT64_MAX;
+}
+
+static bool operand_has_range(const char *operand) {
+    byte_range range;
+    free(operand_path(operand, &range));
+    return is_ranged(&range);
+}
+
+// Whether reading range2 of a size-byte file while range1 of it is
+// rewritten in place could see bytes already written: the read starts
+// behind the write, or the bytes read overlap the bytes written. The write
+// runs as far as the longer of range1 and what is read.
+static bool ranges_clash(const byte_range *range1, const byte_range *range2, uint64_t size) {
+    uint64_t start1 = range1->offset;
+    uint64_t start2 = range2->offset;
+    if (start2 < start1) {
+        return true;
+    }
+    uint64_t read_len = (size > start2) ? size - start2 : 0;
+    if (read_len > range2->length) {
+        read_len = range2->length;
+    }
+    uint64_t write_len = (size > start1) ? size - start1 : 0;
+    if (write_len < read_len) {
+        write_len = read_len;
+    }
+    if (write_len > range1->length) {
+        write_len = range1->length;
+    }
+    return read_len > 0 && write_len > 0 && start2 - start1 < write_len;
+}
+
+// Move a stream that nothing has been read from yet count bytes on: by
+// seeking where possible, otherwise by splicing into /dev/null so the
+// bytes never reach user space, otherwise by reading them
+static void skip_input(int fd, uint64_t count) {
+    if (count == 0 || lseek(fd, (off_t)count, SEEK_CUR) >= 0) {
+        return;
+    }
+#if XOR_SPLICE
+    int null_fd = open("/dev/null", O_WRONLY);
+    while (count > 0 && null_fd >= 0) {
+        size_t len = (count < COPY_CHUNK) ? (size_t)count : COPY_CHUNK;
+        ssize_t n = splice(fd, NULL, null_fd, NULL, len, SPLICE_F_MOVE);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            if (n == 0) {
+                count = 0;  // End of input
+            }
+            break;
+        }
+        count -= (uint64_t)n;
+    }
+    if (null_fd >= 0) {
+        close(null_fd);
+    }
+#endif
+    unsigned char buf[CHUNK_SIZE];
+    while (count > 0) {
+        size_t n = read_full(fd, buf, (count < CHUNK_SIZE) ? (size_t)count : CHUNK_SIZE);
+        if (n == 0) {
+            break;
+        }
+        count -= n;
+    }
+}
+
+static io_engine parse_io_engine(const char *name) {
+    size_t count = sizeof(io_engine_names) / sizeof(io_engine_names[0]);
+    for (size_t i = 0; i < count; i++) {
+        if (strcmp(name, io_engine_names[i]) == 0) {
+            return (io_engine)i;
+        }
+    }
+    
+    char error_msg[256];
+    snprintf(error_msg, sizeof(error_msg), "unknown I/O engine: %s", name);
+    die(error_msg, EXIT_USAGE);
+    return IO_STDIO;
+}
+
+static void open_input_stream(input_stream *in, const char *operand) {
+    memset(in, 0, sizeof(*in));
+    in->fd = -1;
+    
+    byte_range range = { 0, UINT64_MAX };
+    char *filename = (operand == NULL) ? NULL : operand_path(operand, &range);
+    if (filename == NULL || strcmp(filename, "-") == 0) {
+        in->stream = stdin;
+    } else {
+        in->stream = fopen(filename, "rb");
+        if (in->stream == NULL) {
+            if (errno == ENOENT) {
+                die("file not found", EXIT_USAGE);
+            } else if (errno == EACCES) {
+                die("permission denied", EXIT_USAGE);
+            } else {
+                char error_msg[256];
+                snprintf(error_msg, sizeof(error_msg), "cannot open %s: %s", 
+                        filename, strerror(errno));
+                die(error_msg, EXIT_ERROR);
+            }
+        }
+    }
+    free(filename);
+    
+    // Nothing has been read through the stream yet, so its buffer is
+    // still empty and the descriptor can be moved under it
+    int fd = fileno(in->stream);
+    skip_input(fd, range.offset);
+    in->limit = range.length;
+    
+    // Regular files (including stdin redirected from one) are mapped
+    // instead, starting at the descriptor's current offset
+    struct stat st;
+    if (io_mode != IO_MMAP || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        return;
+    }
+    off_t start = lseek(fd, 0, SEEK_CUR);
+    if (start < 0 || start > st.st_size) {
+        return;
+    }
+    in->fd = fd;
+    in->pos = (uint64_t)start;
+    in->size = (uint64_t)st.st_size;
+    if (range.length < in->size - in->pos) {
+        in->size = in->pos + range.length;
+    }
+}
+
+// Slide the mapping window so it covers [pos, pos + len), clamped to EOF.
+static void remap_input(input_stream *in, size_t len) {
+    if (in->map != NULL) {
+        munmap(in->map, in->map_len);
+        in->map = NULL;
+    }
+    
+    uint64_t page = (uint64_t)sysconf(_SC_PAGESIZE);
+    uint64_t offset = in->pos - in->pos % page;
+    uint64_t map_len = MAP_WINDOW;
+    if (map_len < in->pos - offset + len) {
+        map_len = in->pos - offset + len;
+    }
+    if (map_len > in->size - offset) {
+        map_len = in->size - offset;
+    }
+    
+    void *map = mmap(NULL, (size_t)map_len, PROT_READ, MAP_PRIVATE, in->fd, (off_t)offset);
+    if (map == MAP_FAILED) {
+        char error_msg[256];
+        snprintf(error_msg, sizeof(error_msg), "cannot map input: %s", strerror(errno));
+        die(error_msg, EXIT_ERROR);
+    }
+    madvise(map, (size_t)map_len, MADV_SEQUENTIAL);
+    
+    in->map = map;
+    in->map_offset = offset;
+    in->map_len = (size_t)map_len;
+}
+
+// Read up to len bytes. Mapped inputs return a pointer straight into the
+// mapping; stdio inputs are read into buf. Returns 0 at end of input.
+static size_t read_input(input_stream *in, unsigned char *buf, size_t len,
+                         const unsigned char **data) {
+    if (in->fd < 0) {
+        if (len > in->limit) {
+            len = (size_t)in->limit;
+        }
+        *data = buf;
+        uint64_t started = stats_clock();
+        size_t n = (len > 0) ? fread(buf, 1, len, in->stream) : 0;
+        stats_add(&stats.read_ns, started);
+        in->limit -= n;
+        in->consumed += n;
+        return n;
+    }
+    
+    if (in->pos >= in->size) {
+        return 0;
+    }
+    if (len > in->size - in->pos) {
+        len = (size_t)(in->size - in->pos);
+    }
+    if (in->map == NULL || in->pos + len > in->map_offset + in->map_len) {
+        remap_input(in, len);
+    }
+    *data = in->map + (in->pos - in->map_offset);
+    in->pos += len;
+    in->consumed += len;
+    return len;
+}
+
+static bool input_error(const input_stream *in) {
+    return in->fd < 0 && ferror(in->stream);
+}
+
+static void close_input_stream(input_stream *in) {
+    if (in->map != NULL) {
+        munmap(in->map, in->map_len);
+    }
+    if (in->stream != stdin) {
+        fclose(in->stream);
+    }
+}
+
+// xor_key_new() for a key already checked to be 1 to XOR_KEY_MAX bytes
+static xor_key *expand_key(const unsigned char *bytes, size_t len) {
+    xor_key *key;
+    int status = xor_key_new(&key, bytes, len);
+    if (status != XOR_OK) {
+        die(xor_strerror(status), EXIT_ERROR);
+    }
+    return key;
+}
+
+// Read the whole of a --repeat-key key and expand it
+static void load_repeat_key(const char *filename) {
+    input_stream in;
+    open_input_stream(&in, filename);
+    unsigned char *key = NULL;
+    size_t len = 0;
+    for (;;) {
+        unsigned char chunk[CHUNK_SIZE];
+        const unsigned char *data;
+        size_t n = read_input(&in, chunk, CHUNK_SIZE, &data);
+        if (n == 0) {
+            break;
+        }
+        if (len + n > XOR_KEY_MAX) {
+            die("key too long for --repeat-key", EXIT_USAGE);
+        }
+        key = realloc(key, len + n);
+        if (key == NULL) {
+            die("memory allocation failed", EXIT_ERROR);
+        }
+        memcpy(key + len, data, n);
+        len += n;
+    }
+    if (input_error(&in)) {
+        die("read error", EXIT_ERROR);
+    }
+    close_input_stream(&in);
+    if (len == 0) {
+        die("key file is empty", EXIT_USAGE);
+    }
+    stats.input_bytes[1] = len;
+    cyclic_key = expand_key(key, len);
+    free(key);
+}
+
+// chacha20:SEEDFILE, where SEEDFILE holds a 32-byte key and up to 12
+// bytes of nonce. The keystream runs for as long as file1.
+static void load_stream_key(const char *filename) {
+    input_stream in;
+    open_input_stream(&in, filename);
+    unsigned char seed[XOR_KEYSTREAM_SEED];
+    size_t len = 0;
+    for (;;) {
+        unsigned char chunk[CHUNK_SIZE];
+        const unsigned char *data;
+        size_t n = read_input(&in, chunk, CHUNK_SIZE, &data);
+        if (n == 0) {
+            break;
+        }
+        if (len + n > XOR_KEYSTREAM_SEED) {
+            die("seed file must hold a 32-byte key and at most 12 bytes of nonce", EXIT_USAGE);
+        }
+        memcpy(seed + len, data, n);
+        len += n;
+    }
+    if (input_error(&in)) {
+        die("read error", EXIT_ERROR);
+    }
+    close_input_stream(&in);
+    if (len < 32) {
+        die("seed file must hold a 32-byte key and at most 12 bytes of nonce", EXIT_USAGE);
+    }
+    stats.input_bytes[1] = len;
+    
+    int status = xor_key_new_keystream(&cyclic_key, seed, len);
+    if (status != XOR_OK) {
+        die(xor_strerror(status), EXIT_ERROR);
+    }
+    memset(seed, 0, sizeof(seed));
+}
+
+#if XOR_SPLICE
+// Zero-copy output to a pipe. XORed chunks go into a ring of page-aligned
+// buffers and are handed to the pipe with vmsplice, which makes the pipe
+// reference those pages instead of copying them. A buffer may only be
+// rewritten once the reader has drained it, which is when the bytes still
+// in the pipe (FIONREAD) no longer reach back to it; until then the chunk
+// is XORed into a private buffer and written with a copy instead.
+//
+// Pages a reader splices onward (tee, or splice into another pipe or a
+// socket) stay referenced after the pipe drains, so later output could show
+// through. That is why this is opt-in.
+static splice_output *open_splice_output(int fd) {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISFIFO(st.st_mode)) {
+        return NULL;
+    }
+    
+    // Ask for a larger pipe; unprivileged users are capped by pipe-max-size
+    fcntl(fd, F_SETPIPE_SZ, SPLICE_PIPE_SIZE);
+    int pipe_size = fcntl(fd, F_GETPIPE_SZ);
+    if (pipe_size <= 0) {
+        return NULL;
+    }
+    
+    splice_output *sp = calloc(1, sizeof(*sp));
+    if (sp == NULL) {
+        die("memory allocation failed", EXIT_ERROR);
+    }
+    sp->fd = fd;
+    sp->pipe_size = (size_t)pipe_size;
+    sp->count = sp->pipe_size / CHUNK_SIZE + 2;
+    sp->marks = calloc(sp->count, sizeof(*sp->marks));
+    if (sp->marks == NULL ||
+        posix_memalign((void **)&sp->buffers, PIPELINE_ALIGN, (sp->count + 1) * (size_t)CHUNK_SIZE) != 0) {
+        die("memory allocation failed", EXIT_ERROR);
+    }
+    sp->private_buffer = sp->buffers + sp->count * (size_t)CHUNK_SIZE;
+    return sp;
+}
+
+static void close_splice_output(splice_output *sp) {
+    char progress_msg[256];
+    snprintf(progress_msg, sizeof(progress_msg), "vmspliced %" PRIu64 " of %" PRIu64 " bytes",
+            sp->vmspliced, sp->spliced);
+    progress(progress_msg);
+    free(sp->buffers);
+    free(sp->marks);
+    free(sp);
+}
+
+// Pick the buffer for the next chunk: the next ring buffer if the reader
+// has drained it, otherwise the private one.
+static unsigned char *splice_buffer(splice_output *sp) {
+    size_t index = sp->next % sp->count;
+    int queued = 0;
+    if (sp->marks[index] + sp->pipe_size > sp->spliced &&
+        (ioctl(sp->fd, FIONREAD, &queued) != 0 || sp->marks[index] > sp->spliced - (uint64_t)queued)) {
+        return sp->private_buffer;
+    }
+    sp->next++;
+    return sp->buffers + index * CHUNK_SIZE;
+}
+
+static void splice_write(splice_output *sp, const unsigned char *data, size_t len) {
+    bool in_ring = data >= sp->buffers && data < sp->private_buffer;
+    bool immutable = data >= zero_chunk && data < zero_chunk + CHUNK_SIZE;
+    
+    while (len > 0) {
+        ssize_t n;
+        if (in_ring || immutable) {
+            struct iovec iov = { (void *)data, len };
+            n = vmsplice(sp->fd, &iov, 1, 0);
+        } else {
+            n = write(sp->fd, data, len);
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            die("write error", EXIT_ERROR);
+        }
+        if (in_ring || immutable) {
+            sp->vmspliced += (uint64_t)n;
+        }
+        data += n;
+        len -= (size_t)n;
+        sp->spliced += (uint64_t)n;
+    }
+    
+    // The buffer is busy until the pipe has been drained past this point
+    if (in_ring) {
+        sp->marks[(size_t)(data - 1 - sp->buffers) / CHUNK_SIZE] = sp->spliced;
+    }
+}
+#endif
+
+static void write_output(output_state *out, const unsigned char *data, size_t len) {
+    if (len == 0) {
+        return;
+    }
+    uint64_t started = stats_clock();
+#if XOR_SPLICE
+    if (out->splice != NULL) {
+        splice_write(out->splice, data, len);
+        out->bytes_written += len;
+        stats_add(&stats.write_ns, started);
+        return;
+    }
+#endif
+    if (fwrite(data, 1, len, out->stream) != len) {
+        die("write error", EXIT_ERROR);
+    }
+    out->bytes_written += len;
+    stats_add(&stats.write_ns, started);
+}
+
+static void write_zeros(output_state *out, uint64_t count) {
+    while (count > 0) {
+        size_t n = count > CHUNK_SIZE ? CHUNK_SIZE : (size_t)count;
+        write_output(out, zero_chunk, n);
+        count -= n;
+    }
+}
+
+// Write one XORed chunk of len bytes whose last nonzero byte ends at
+// data_len. Zeros held back from earlier chunks are flushed first, and the
+// chunk's own trailing zeros are added to the held-back run.
+static void emit_chunk(output_state *out, const unsigned char *data, size_t len, size_t data_len) {
+    if (out->truncate_fd >= 0) {
+        write_output(out, data, len);
+        if (data_len > 0) {
+            out->data_end = out->bytes_written - (len - data_len);
+        }
+        return;
+    }
+    if (data_len > 0) {
+        write_zeros(out, out->pending_zeros);
+        out->pending_zeros = 0;
+        write_output(out, data, data_len);
+    }
+    out->pending_zeros += len - data_len;
+}
+
+// XOR two chunks of possibly different lengths into dst, treating the
+// shorter one as zero-padded. Returns the length up to the last nonzero
+// byte, as the kernels do.
+static size_t xor_chunk(unsigned char *dst, const unsigned char *data1, size_t len1,
+                        const unsigned char *data2, size_t len2) {
+    size_t min_len = (len1 < len2) ? len1 : len2;
+    size_t max_len = (len1 > len2) ? len1 : len2;
+    size_t data_len = xor_buffers(dst, data1, data2, min_len);
+    
+    // Past the shorter input, XOR the longer one against zero padding
+    const unsigned char *longer = (len1 > len2) ? data1 : data2;
+    for (size_t i = min_len; i < max_len; i += CHUNK_SIZE) {
+        size_t n = (max_len - i < CHUNK_SIZE) ? max_len - i : CHUNK_SIZE;
+        size_t tail_len = xor_buffers(dst + i, longer + i, zero_chunk, n);
+        if (tail_len > 0) {
+            data_len = i + tail_len;
+        }
+    }
+    return data_len;
+}
+
+// The serial engines XOR through libxor's streaming context, which pads the
+// shorter input and keeps track of where the output's trailing zeros begin
+static xor_stream *open_xor_stream(const xor_key *key) {
+    xor_stream *xs;
+    int status = xor_stream_init(&xs, key);
+    if (status != XOR_OK) {
+        die(xor_strerror(status), EXIT_ERROR);
+    }
+    return xs;
+}
+
+static void close_xor_stream(xor_stream *xs) {
+    int status = xor_stream_finish(xs, NULL, NULL);
+    if (status != XOR_OK) {
+        die(xor_strerror(status), EXIT_ERROR);
+    }
+}
+
+// xor_chunk() through the stream: returns the chunk's length up to its
+// last nonzero byte, from where the stream saw its output end. With a key,
+// data2 is unused.
+static size_t stream_chunk(xor_stream *xs, unsigned char *dst, const unsigned char *data1, size_t len1,
+                           const unsigned char *data2, size_t len2) {
+    size_t min_len = (len1 < len2) ? len1 : len2;
+    size_t max_len = (len1 > len2) ? len1 : len2;
+    uint64_t start;
+    uint64_t data_end;
+    int status = xor_stream_tell(xs, &start, NULL);
+    if (status == XOR_OK) {
+        status = xor_stream_update(xs, dst, data1, data2, min_len);
+    }
+    
+    // Past the shorter input, the stream pads it with zeros
+    if (status == XOR_OK && max_len > min_len) {
+        status = xor_stream_update(xs, dst + min_len, (len1 > len2) ? data1 + min_len : NULL,
+                                   (len2 > len1) ? data2 + min_len : NULL, max_len - min_len);
+    }
+    if (status == XOR_OK) {
+        status = xor_stream_tell(xs, NULL, &data_end);
+    }
+    if (status != XOR_OK) {
+        die(xor_strerror(status), EXIT_ERROR);
+    }
+    return (data_end > start) ? (size_t)(data_end - start) : 0;
+}
+
+static void report_progress(uint64_t bytes_processed, uint64_t *next_report) {
+    if (show_progress && bytes_processed >= *next_report) {
+        char progress_msg[256];
+        snprintf(progress_msg, sizeof(progress_msg), "processed %" PRIu64 " bytes", bytes_processed);
+        progress(progress_msg);
+        *next_report = bytes_processed - bytes_processed % PROGRESS_INTERVAL + PROGRESS_INTERVAL;
+    }
+}
+
+// Copy what is left of a mapped input to the output in the kernel and
+// return its length. Its trailing zeros are held back as usual.
+static uint64_t copy_stream_tail(input_stream *in, output_state *out) {
+    uint64_t start = in->pos;
+    uint64_t data_end = find_data_end(in->fd, start, in->size);
+    if (data_end > start) {
+        write_zeros(out, out->pending_zeros);
+        out->pending_zeros = 0;
+        if (fflush(out->stream) != 0) {
+            die("write error", EXIT_ERROR);
+        }
+        copy_range(in->fd, start, fileno(out->stream), NULL, data_end - start);
+        out->bytes_written += data_end - start;
+        out->data_end = out->bytes_written;
+    }
+    out->pending_zeros += in->size - data_end;
+    in->pos = in->size;
+    in->consumed += in->size - start;
+    return in->size - start;
+}
+
+// Single-threaded engine: read a chunk of each input, XOR, write, repeat.
+static uint64_t xor_serial(input_stream *in1, input_stream *in2, output_state *out) {
+    uint64_t bytes_processed = 0;
+    uint64_t next_report = PROGRESS_INTERVAL;
+    xor_stream *xs = open_xor_stream(NULL);
+    
+    while (!interrupted) {
+        unsigned char chunk1[CHUNK_SIZE];  // Only filled by stdio inputs
+        unsigned char chunk2[CHUNK_SIZE];
+        unsigned char result_chunk[CHUNK_SIZE];
+        unsigned char *result = result_chunk;
+#if XOR_SPLICE
+        if (out->splice != NULL) {
+            result = splice_buffer(out->splice);
+        }
+#endif
+        
+        const unsigned char *data1;
+        const unsigned char *data2;
+        size_t read1 = read_input(in1, chunk1, CHUNK_SIZE, &data1);
+        size_t read2 = read_input(in2, chunk2, CHUNK_SIZE, &data2);
+        
+        if (read1 == 0 && read2 == 0) {
+            break;  // Both streams exhausted
+        }
+        
+        // The kernel also reports where trailing zeros begin
+        size_t max_len = (read1 > read2) ? read1 : read2;
+        uint64_t started = stats_clock();
+        size_t data_len = stream_chunk(xs, result, data1, read1, data2, read2);
+        stats_add(&stats.compute_ns, started);
+        emit_chunk(out, result, max_len, data_len);
+        bytes_processed += max_len;
+        report_progress(bytes_processed, &next_report);
+        
+        // Once one input ends, the rest of a mapped file is a plain copy
+        if (out->splice == NULL && (read1 < CHUNK_SIZE) != (read2 < CHUNK_SIZE)) {
+            input_stream *rest = (read1 < CHUNK_SIZE) ? in2 : in1;
+            if (rest->fd >= 0) {
+                bytes_processed += copy_stream_tail(rest, out);
+            }
+        }
+    }
+    
+    if (input_error(in1) || input_error(in2)) {
+        die("read error", EXIT_ERROR);
+    }
+    close_xor_stream(xs);
+    return bytes_processed;
+}
+
+// xor_serial() for three or more inputs, XORing every chunk of all of
+// them in one pass of the multi-source kernel
+static uint64_t xor_multi_serial(input_stream *inputs, size_t count, output_state *out) {
+    uint64_t bytes_processed = 0;
+    uint64_t next_report = PROGRESS_INTERVAL;
+    unsigned char *chunks = malloc((count + 1) * (size_t)CHUNK_SIZE);
+    bool *finished = calloc(count, sizeof(*finished));
+    if (chunks == NULL || finished == NULL) {
+        die("memory allocation failed", EXIT_ERROR);
+    }
+    unsigned char *result_chunk = chunks + count * (size_t)CHUNK_SIZE;
+    
+    while (!interrupted) {
+        const unsigned char *data[MAX_INPUTS];
+        size_t lens[MAX_INPUTS];
+        size_t max_len = 0;
+        size_t remaining = 0;
+        for (size_t k = 0; k < count; k++) {
+            lens[k] = finished[k] ? 0 : read_input(&inputs[k], chunks + k * CHUNK_SIZE, CHUNK_SIZE, &data[k]);
+            finished[k] = lens[k] < CHUNK_SIZE;
+            max_len = (lens[k] > max_len) ? lens[k] : max_len;
+            remaining += !finished[k];
+        }
+        if (max_len == 0) {
+            break;
+        }
+        
+        // An input that ends inside this chunk is zero-padded in its own buffer
+        const unsigned char *src[MAX_INPUTS];
+        size_t active = 0;
+        for (size_t k = 0; k < count; k++) {
+            if (lens[k] == 0) {
+                continue;
+            }
+            if (lens[k] < max_len) {
+                unsigned char *buf = chunks + k * CHUNK_SIZE;
+                memmove(buf, data[k], lens[k]);
+                memset(buf + lens[k], 0, max_len - lens[k]);
+                data[k] = buf;
+            }
+            src[active++] = data[k];
+        }
+        
+        unsigned char *result = result_chunk;
+#if XOR_SPLICE
+        if (out->splice != NULL) {
+            result = splice_buffer(out->splice);
+        }
+#endif
+        uint64_t started = stats_clock();
+        size_t data_len = xor_buffers_multi(result, src, active, max_len);
+        stats_add(&stats.compute_ns, started);
+        emit_chunk(out, result, max_len, data_len);
+        bytes_processed += max_len;
+        report_progress(bytes_processed, &next_report);
+        
+        // With one input left, the rest of it is a plain copy
+        for (size_t k = 0; remaining == 1 && out->splice == NULL && k < count; k++) {
+            if (!finished[k] && inputs[k].fd >= 0) {
+                bytes_processed += copy_stream_tail(&inputs[k], out);
+                finished[k] = true;
+            }
+        }
+    }
+    
+    for (size_t k = 0; k < count; k++) {
+        if (input_error(&inputs[k])) {
+            die("read error", EXIT_ERROR);
+        }
+    }
+    free(chunks);
+    free(finished);
+    return bytes_processed;
+}
+
+// xor_serial() for --repeat-key, where file2 has become cyclic_key
+static uint64_t xor_repeat_serial(input_stream *in, output_state *out) {
+    uint64_t bytes_processed = 0;
+    uint64_t next_report = PROGRESS_INTERVAL;
+    xor_stream *xs = open_xor_stream(cyclic_key);
+    
+    while (!interrupted) {
+        unsigned char chunk[CHUNK_SIZE];
+        unsigned char result[CHUNK_SIZE];
+        const unsigned char *data;
+        size_t len = read_input(in, chunk, CHUNK_SIZE, &data);
+        if (len == 0) {
+            break;
+        }
+        
+        uint64_t started = stats_clock();
+        size_t data_len = stream_chunk(xs, result, data, len, NULL, 0);
+        stats_add(&stats.compute_ns, started);
+        emit_chunk(out, result, len, data_len);
+        bytes_processed += len;
+        report_progress(bytes_processed, &next_report);
+    }
+    
+    if (input_error(in)) {
+        die("read error", EXIT_ERROR);
+    }
+    close_xor_stream(xs);
+    return bytes_processed;
+}
+
+// Wait for another pipeline stage: spin briefly, then yield, then sleep,
+// so a stage stalled on slow I/O does not keep a core busy.
+static void pipeline_backoff(unsigned *spins) {
+    if (*spins < 64) {
+#if XOR_X86
+        _mm_pause();
+#endif
+    } else if (*spins < 1024) {
+        sched_yield();
+    } else {
+        struct timespec ts = { 0, 50000 };
+        nanosleep(&ts, NULL);
+    }
+    (*spins)++;
+}
+
+// Producer side: wait for a free slot, fill it, then publish it.
+static pipeline_slot *ring_acquire_write(spsc_ring *ring) {
+    unsigned spins = 0;
+    while (ring->head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == PIPELINE_SLOTS) {
+        pipeline_backoff(&spins);
+    }
+    return &ring->slots[ring->head % PIPELINE_SLOTS];
+}
+
+static void ring_publish(spsc_ring *ring) {
+    __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+}
+
+// Consumer side: wait for a published slot, use it, then release it.
+static pipeline_slot *ring_acquire_read(spsc_ring *ring) {
+    unsigned spins = 0;
+    while (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == ring->tail) {
+        pipeline_backoff(&spins);
+    }
+    return &ring->slots[ring->tail % PIPELINE_SLOTS];
+}
+
+static void ring_release(spsc_ring *ring) {
+    __atomic_store_n(&ring->tail, ring->tail + 1, __ATOMIC_RELEASE);
+}
+
+static void ring_init(spsc_ring *ring) {
+    memset(ring, 0, sizeof(*ring));
+    void *buffers;
+    if (posix_memalign(&buffers, PIPELINE_ALIGN, (size_t)PIPELINE_SLOTS * PIPELINE_CHUNK) != 0) {
+        die("memory allocation failed", EXIT_ERROR);
+    }
+    for (size_t i = 0; i < PIPELINE_SLOTS; i++) {
+        ring->slots[i].data = (unsigned char *)buffers + i * PIPELINE_CHUNK;
+    }
+}
+
+static void ring_free(spsc_ring *ring) {
+    free(ring->slots[0].data);
+}
+
+// Fill buf from fd, stopping short only at end of input
+static size_t read_full(int fd, unsigned char *buf, size_t len) {
+    uint64_t started = stats_clock();
+    size_t total = 0;
+    while (total < len) {
+        ssize_t n = read(fd, buf + total, len - total);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            die("read error", EXIT_ERROR);
+        }
+        if (n == 0) {
+            break;
+        }
+        total += (size_t)n;
+    }
+    stats_add(&stats.read_ns, started);
+    return total;
+}
+
+// Reader stage: one thread per input, reading straight from the
+// descriptor into ring slots. A zero-length slot marks end of input.
+static void *pipeline_reader(void *arg) {
+    pipeline_stage *stage = arg;
+    int fd = fileno(stage->in->stream);
+    size_t len;
+    do {
+        pipeline_slot *slot = ring_acquire_write(stage->ring);
+        len = (stage->in->limit < PIPELINE_CHUNK) ? (size_t)stage->in->limit : PIPELINE_CHUNK;
+        len = read_full(fd, slot->data, len);
+        stage->in->limit -= len;
+        stage->in->consumed += len;
+        slot->len = len;
+        ring_publish(stage->ring);
+    } while (len > 0);
+    return NULL;
+}
+
+// Writer stage: apply the zero holdback and write each XORed slot
+static void *pipeline_writer(void *arg) {
+    pipeline_stage *stage = arg;
+    for (;;) {
+        pipeline_slot *slot = ring_acquire_read(stage->ring);
+        size_t len = slot->len;
+        if (len > 0) {
+            emit_chunk(stage->out, slot->data, len, slot->data_len);
+        }
+        ring_release(stage->ring);
+        if (len == 0) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+// Threaded engine: a reader thread per input and a writer thread, joined
+// to the XOR stage on this thread by lock-free single-producer,
+// single-consumer rings, so I/O on both inputs and the output overlaps
+// with compute.
+static uint64_t xor_pipeline(input_stream *in1, input_stream *in2, output_state *out) {
+    spsc_ring *rings;
+    if (posix_memalign((void **)&rings, PIPELINE_ALIGN, 3 * sizeof(spsc_ring)) != 0) {
+        die("memory allocation failed", EXIT_ERROR);
+    }
+    spsc_ring *ring1 = &rings[0];
+    spsc_ring *ring2 = &rings[1];
+    spsc_ring *ring_out = &rings[2];
+    ring_init(ring1);
+    ring_init(ring2);
+    ring_init(ring_out);
+    
+    pipeline_stage stages[3] = {
+        { in1, ring1, NULL },
+        { in2, ring2, NULL },
+        { NULL, ring_out, out },
+    };
+    pthread_t threads[3];
+    if (pthread_create(&threads[0], NULL, pipeline_reader, &stages[0]) != 0 ||
+        pthread_create(&threads[1], NULL, pipeline_reader, &stages[1]) != 0 ||
+        pthread_create(&threads[2], NULL, pipeline_writer, &stages[2]) != 0) {
+        die("cannot start pipeline threads", EXIT_ERROR);
+    }
+    
+    uint64_t bytes_processed = 0;
+    uint64_t next_report = PROGRESS_INTERVAL;
+    bool eof1 = false;
+    bool eof2 = false;
+    
+    for (;;) {
+        pipeline_slot *slot1 = eof1 ? NULL : ring_acquire_read(ring1);
+        pipeline_slot *slot2 = eof2 ? NULL : ring_acquire_read(ring2);
+        size_t read1 = slot1 ? slot1->len : 0;
+        size_t read2 = slot2 ? slot2->len : 0;
+        eof1 = (read1 == 0);
+        eof2 = (read2 == 0);
+        
+        pipeline_slot *result = ring_acquire_write(ring_out);
+        size_t max_len = (read1 > read2) ? read1 : read2;
+        result->len = max_len;
+        uint64_t started = stats_clock();
+        result->data_len = xor_chunk(result->data, slot1 ? slot1->data : zero_chunk, read1,
+                                     slot2 ? slot2->data : zero_chunk, read2);
+        stats_add(&stats.compute_ns, started);
+        ring_publish(ring_out);
+        
+        // The end-of-input slot stays unreleased; nothing follows it
+        if (read1 > 0) ring_release(ring1);
+        if (read2 > 0) ring_release(ring2);
+        
+        if (max_len == 0) {
+            break;  // Both streams exhausted; the writer saw the empty slot
+        }
+        bytes_processed += max_len;
+        report_progress(bytes_processed, &next_report);
+    }
+    
+    for (size_t i = 0; i < 3; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    ring_free(ring1);
+    ring_free(ring2);
+    ring_free(ring_out);
+    free(rings);
+    return bytes_processed;
+}
+
+// pread/pwrite the whole range, retrying after signals and short transfers
+static void pread_full(int fd, unsigned char *buf, size_t len, uint64_t offset) {
+    uint64_t started = stats_clock();
+    while (len > 0) {
+        ssize_t n = pread(fd, buf, len, (off_t)offset);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            die(n == 0 ? "input file shrank while reading" : "read error", EXIT_ERROR);
+        }
+        buf += n;
+        len -= (size_t)n;
+        offset += (uint64_t)n;
+    }
+    stats_add(&stats.read_ns, started);
+}
+
+static void pwrite_full(int fd, const unsigned char *buf, size_t len, uint64_t offset) {
+    uint64_t started = stats_clock();
+    while (len > 0) {
+        ssize_t n = pwrite(fd, buf, len, (off_t)offset);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            die("write error", EXIT_ERROR);
+        }
+        buf += n;
+        len -= (size_t)n;
+        offset += (uint64_t)n;
+    }
+    stats_add(&stats.write_ns, started);
+}
+
+// Find the end of the last nonzero byte of fd between start and end by
+// reading backwards, or start if the range is all zeros
+static uint64_t find_data_end(int fd, uint64_t start, uint64_t end) {
+    unsigned char buf[CHUNK_SIZE];
+    while (end > start) {
+        size_t len = (end - start < CHUNK_SIZE) ? (size_t)(end - start) : CHUNK_SIZE;
+        pread_full(fd, buf, len, end - len);
+        size_t data_len = xor_data_length(buf, len);
+        if (data_len > 0) {
+            return end - len + data_len;
+        }
+        end -= len;
+    }
+    return start;
+}
+
+static void write_full(int fd, const unsigned char *buf, size_t len) {
+    uint64_t started = stats_clock();
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            die("write error", EXIT_ERROR);
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+    stats_add(&stats.write_ns, started);
+}
+
+// One kernel-side copy: copy_file_range between regular files, which can
+// share extents on XFS and btrfs, otherwise sendfile, which splices into
+// pipes and sockets. Returns -1 with errno set when neither applies.
+static ssize_t kernel_copy(int in_fd, uint64_t offset, int out_fd, off_t *out_off,
+                           size_t len, bool regular) {
+#ifdef __linux__
+    off_t in_off = (off_t)offset;
+    if (regular) {
+        ssize_t n = copy_file_range(in_fd, &in_off, out_fd, out_off, len, 0);
+        if (n >= 0 || errno == EINTR || out_off != NULL) {
+            return n;
+        }
+    }
+    return sendfile(out_fd, in_fd, &in_off, len);
+#else
+    (void)in_fd;
+    (void)offset;
+    (void)out_fd;
+    (void)out_off;
+    (void)len;
+    (void)regular;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+// Copy len bytes of in_fd at offset to out_fd without XORing, in the kernel
+// where it can be. out_off NULL writes at out_fd's file position; otherwise
+// at *out_off, which is advanced.
+static void copy_range(int in_fd, uint64_t offset, int out_fd, off_t *out_off, uint64_t len) {
+    struct stat st;
+    bool regular = fstat(out_fd, &st) == 0 && S_ISREG(st.st_mode);
+    bool use_kernel = true;
+    unsigned char buf[CHUNK_SIZE];
+    
+    while (len > 0 && !interrupted) {
+        size_t want = (len < COPY_CHUNK) ? (size_t)len : COPY_CHUNK;
+        ssize_t n;
+        if (use_kernel) {
+            uint64_t started = stats_clock();
+            n = kernel_copy(in_fd, offset, out_fd, out_off, want, regular);
+            stats_add(&stats.write_ns, started);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0 && (errno == EINVAL || errno == ENOSYS || errno == EXDEV ||
+                          errno == EBADF || errno == EOPNOTSUPP)) {
+                use_kernel = false;  // e.g. O_APPEND output or an old kernel
+                continue;
+            }
+            if (n <= 0) {
+                die(n == 0 ? "input file shrank while reading" : "write error", EXIT_ERROR);
+            }
+        } else {
+            n = (ssize_t)((want < CHUNK_SIZE) ? want : CHUNK_SIZE);
+            pread_full(in_fd, buf, (size_t)n, offset);
+            if (out_off != NULL) {
+                pwrite_full(out_fd, buf, (size_t)n, (uint64_t)*out_off);
+                *out_off += n;
+            } else {
+                write_full(out_fd, buf, (size_t)n);
+            }
+        }
+        offset += (uint64_t)n;
+        len -= (uint64_t)n;
+    }
+}
+
+// Copy the data in [start, end) of in_fd to the same offsets of out_fd,
+// leaving holes in the input as holes in the output. Returns the bytes
+// copied.
+static uint64_t copy_data_ranges(int in_fd, uint64_t start, uint64_t end, int out_fd) {
+    uint64_t copied = 0;
+    while (start < end) {
+        uint64_t data = start;
+        uint64_t hole = end;
+#ifdef SEEK_DATA
+        off_t pos = lseek(in_fd, (off_t)start, SEEK_DATA);
+        if (pos < 0) {
+            break;  // Only a hole left
+        }
+        data = (uint64_t)pos;
+        pos = lseek(in_fd, pos, SEEK_HOLE);
+        if (pos >= 0 && (uint64_t)pos < end) {
+            hole = (uint64_t)pos;
+        }
+#endif
+        if (data >= end) {
+            break;
+        }
+        off_t out_off = (off_t)data;
+        copy_range(in_fd, data, out_fd, &out_off, hole - data);
+        copied += hole - data;
+        start = hole;
+    }
+    return copied;
+}
+
+// Bytes of a size-byte file that fall in [offset, offset + len)
+static size_t span_in_file(uint64_t size, uint64_t offset, size_t len) {
+    if (offset >= size) {
+        return 0;
+    }
+    return (size - offset < len) ? (size_t)(size - offset) : len;
+}
+
+// Whether [offset, offset + len) of fd holds no data at all
+static bool range_is_hole(int fd, uint64_t offset, size_t len) {
+#ifdef SEEK_DATA
+    off_t data = lseek(fd, (off_t)offset, SEEK_DATA);
+    if (data < 0) {
+        return errno == ENXIO;  // No data from offset to the end of the file
+    }
+    return (uint64_t)data >= offset + len;
+#else
+    (void)fd;
+    (void)offset;
+    (void)len;
+    return false;
+#endif
+}
+
+static bool file_has_holes(int fd, uint64_t size) {
+#ifdef SEEK_HOLE
+    off_t hole = lseek(fd, 0, SEEK_HOLE);
+    return hole >= 0 && (uint64_t)hole < size;
+#else
+    (void)fd;
+    (void)size;
+    return false;
+#endif
+}
+
+// Write the nonzero SPARSE_BLOCK runs of buf, skipping the all-zero ones
+static void pwrite_data_blocks(int fd, const unsigned char *buf, size_t len, uint64_t offset) {
+    size_t pos = 0;
+    while (pos < len) {
+        size_t start = pos;
+        while (pos < len) {
+            size_t block = (len - pos < SPARSE_BLOCK) ? len - pos : SPARSE_BLOCK;
+            if (xor_data_length(buf + pos, block) == 0) {
+                break;
+            }
+            pos += block;
+        }
+        if (pos > start) {
+            pwrite_full(fd, buf + start, pos - start, offset + start);
+        }
+        pos += (len - pos < SPARSE_BLOCK) ? len - pos : SPARSE_BLOCK;
+    }
+}
+
+static void *parallel_worker_main(void *arg) {
+    parallel_worker *worker = arg;
+    parallel_job *job = worker->job;
+    
+    unsigned char *buffers;
+    if (posix_memalign((void **)&buffers, PIPELINE_ALIGN, 3 * (size_t)PARALLEL_CHUNK) != 0) {
+        die("memory allocation failed", EXIT_ERROR);
+    }
+    unsigned char *buf1 = buffers;
+    unsigned char *buf2 = buffers + PARALLEL_CHUNK;
+    unsigned char *result = buffers + 2 * (size_t)PARALLEL_CHUNK;
+    
+    while (!interrupted) {
+        uint64_t index = __atomic_fetch_add(&job->next_chunk, 1, __ATOMIC_RELAXED);
+        if (index >= (job->total + PARALLEL_CHUNK - 1) / PARALLEL_CHUNK) {
+            break;
+        }
+        uint64_t offset = index * PARALLEL_CHUNK;
+        size_t len = span_in_file(job->total, offset, PARALLEL_CHUNK);
+        size_t len1 = span_in_file(job->size1, offset, len);
+        size_t len2 = span_in_file(job->size2, offset, len);
+        
+        // Holes read as zeros, which is what a zero-length read pads with
+        if (job->sparse) {
+            if (len1 > 0 && range_is_hole(job->fd1, offset, len1)) {
+                len1 = 0;
+            }
+            if (len2 > 0 && range_is_hole(job->fd2, offset, len2)) {
+                len2 = 0;
+            }
+        }
+        pread_full(job->fd1, buf1, len1, offset);
+        pread_full(job->fd2, buf2, len2, offset);
+        __atomic_add_fetch(&job->bytes_read[0], len1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&job->bytes_read[1], len2, __ATOMIC_RELAXED);
+        
+        unsigned char *dst = (job->out_map != NULL) ? job->out_map + offset : result;
+        size_t data_len;
+        uint64_t started = stats_clock();
+        if (in_place && cyclic_key == NULL && len2 == 0) {
+            data_len = xor_data_length(buf1, len1);  // A hole in file2 leaves file1 as it is
+            stats_add(&stats.compute_ns, started);
+        } else {
+            if (cyclic_key != NULL) {
+                memset(buf1 + len1, 0, len - len1);
+                data_len = xor_key_apply(cyclic_key, dst, buf1, len, offset);
+            } else {
+                data_len = xor_chunk(dst, buf1, len1, buf2, len2);
+            }
+            stats_add(&stats.compute_ns, started);
+            
+            // Sparse output only gets its nonzero blocks written
+            if (job->sparse && !in_place) {
+                pwrite_data_blocks(job->out_fd, result, data_len, offset);
+            } else if (job->out_map == NULL) {
+                pwrite_full(job->out_fd, result, len, offset);
+            }
+        }
+        
+        if (data_len > 0 && offset + data_len > worker->data_end) {
+            worker->data_end = offset + data_len;
+        }
+        
+        // Whichever worker crosses a reporting boundary prints the update
+        uint64_t done = __atomic_add_fetch(&job->bytes_done, len, __ATOMIC_RELAXED);
+        if (show_progress && done / PROGRESS_INTERVAL != (done - len) / PROGRESS_INTERVAL) {
+            char progress_msg[256];
+            snprintf(progress_msg, sizeof(progress_msg), "processed %" PRIu64 " bytes", done);
+            progress(progress_msg);
+        }
+    }
+    
+    free(buffers);
+    return NULL;
+}
+
+static int open_input_fd(const char *filename) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        char error_msg[256];
+        snprintf(error_msg, sizeof(error_msg), "cannot open %s: %s", filename, strerror(errno));
+        die(error_msg, EXIT_ERROR);
+    }
+    return fd;
+}
+
+// Reserve disk blocks for the whole output in one extent rather than
+// letting it grow a chunk at a time. Returns false if the filesystem
+// cannot preallocate.
+static bool preallocate_output(int fd, uint64_t size) {
+#ifdef __linux__
+    if (fallocate(fd, 0, 0, (off_t)size) == 0) {
+        return true;
+    }
+    if (errno == ENOSPC) {
+        die("not enough space for output file", EXIT_ERROR);
+    }
+#else
+    (void)fd;
+    (void)size;
+#endif
+    return false;
+}
+
+// XOR two regular files into out_fd at the same offsets and return the
+// end of the last nonzero byte of the result. Each work item is read in
+// full before it is written, so out_fd may be file1. Past the shorter
+// input the result is the longer one, which is copied rather than XORed.
+// bytes_read gets what was read of each input, holes skipped.
+static uint64_t xor_parallel(const char *file1, uint64_t size1, const char *file2,
+                             uint64_t size2, int out_fd, uint64_t bytes_read[2]) {
+    if (cyclic_key != NULL) {
+        size2 = 0;  // file2 has already been read as the key
+    }
+    parallel_job job;
+    memset(&job, 0, sizeof(job));
+    job.fd1 = open_input_fd(file1);
+    job.fd2 = (cyclic_key != NULL) ? -1 : open_input_fd(file2);
+    job.out_fd = out_fd;
+    job.size1 = size1;
+    job.size2 = size2;
+    job.total = (size1 < size2 || cyclic_key != NULL) ? size1 : size2;
+    job.sparse = file_has_holes(job.fd1, size1) || file_has_holes(job.fd2, size2);
+    if (job.sparse) {
+        progress("sparse input: skipping holes and leaving zero blocks unwritten");
+    }
+    
+    // With the blocks reserved up front, workers can store straight into a
+    // shared mapping without risking SIGBUS on a full filesystem. Sparse
+    // output would lose its holes that way.
+    if (!job.sparse && job.total > 0 && job.total <= SIZE_MAX && preallocate_output(out_fd, job.total)) {
+        void *map = mmap(NULL, (size_t)job.total, PROT_READ | PROT_WRITE, MAP_SHARED, out_fd, 0);
+        if (map != MAP_FAILED) {
+            job.out_map = map;
+        }
+    }
+    
+    parallel_worker *workers = calloc((size_t)jobs, sizeof(*workers));
+    if (workers == NULL) {
+        die("memory allocation failed", EXIT_ERROR);
+    }
+    for (long i = 0; i < jobs; i++) {
+        workers[i].job = &job;
+        if (pthread_create(&workers[i].thread, NULL, parallel_worker_main, &workers[i]) != 0) {
+            die("cannot start worker threads", EXIT_ERROR);
+        }
+    }
+    
+    uint64_t data_end = 0;
+    for (long i = 0; i < jobs; i++) {
+        pthread_join(workers[i].thread, NULL);
+        if (workers[i].data_end > data_end) {
+            data_end = workers[i].data_end;
+        }
+    }
+    free(workers);
+    if (job.out_map != NULL) {
+        munmap(job.out_map, (size_t)job.total);
+    }
+    
+    // Trailing zeros of the tail are never copied; the final truncation
+    // either drops them or recreates them as a hole
+    int tail_fd = (size1 > size2 || cyclic_key != NULL) ? job.fd1 : job.fd2;
+    uint64_t tail_end = find_data_end(tail_fd, job.total, (size1 > size2) ? size1 : size2);
+    if (tail_end > job.total) {
+        data_end = tail_end;
+        if (!(in_place && tail_fd == job.fd1)) {
+            char progress_msg[256];
+            snprintf(progress_msg, sizeof(progress_msg), "copying %" PRIu64 " bytes past the shorter input",
+                    tail_end - job.total);
+            progress(progress_msg);
+            job.bytes_read[tail_fd == job.fd1 ? 0 : 1] += copy_data_ranges(tail_fd, job.total, tail_end, out_fd);
+        }
+    }
+    bytes_read[0] = job.bytes_read[0];
+    bytes_read[1] = job.bytes_read[1];
+    close(job.fd1);
+    if (job.fd2 >= 0) {
+        close(job.fd2);
+    }
+    return data_end;
+}
+
+#if XOR_URING
+// io_uring engine, driven through the raw system calls so no extra library
+// is needed. Chunk k of each input and of the output lives in slot
+// k % URING_DEPTH of that stream's registered buffer region. Regular files
+// keep up to URING_DEPTH reads in flight per input, and a regular-file
+// output up to URING_WRITES writes; pipes and devices have no offsets, so
+// they get one sequential operation at a time.
+
+static int uring_enter(uring *ring, unsigned min_complete) {
+    for (;;) {
+        long ret = syscall(__NR_io_uring_enter, ring->fd, ring->to_submit, min_complete,
+                           min_complete ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        if (ret >= 0) {
+            ring->to_submit -= (unsigned)ret;
+            return (int)ret;
+        }
+        if (errno != EINTR) {
+            return -1;
+        }
+    }
+}
+
+static void uring_teardown(uring *ring) {
+    if (ring->sqes != NULL) {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+    if (ring->cq_ring != NULL && ring->cq_ring != ring->sq_ring) {
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+    if (ring->sq_ring != NULL) {
+        munmap(ring->sq_ring, ring->sq_ring_size);
+    }
+    close(ring->fd);
+}
+
+static void *uring_map(uring *ring, size_t size, off_t offset) {
+    void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     ring->fd, offset);
+    return (map == MAP_FAILED) ? NULL : map;
+}
+
+// Map the rings and register the buffer regions. Returns false, with
+// nothing left allocated, if the kernel cannot provide any of it.
+static bool uring_setup(uring *ring, unsigned entries, const struct iovec *regions,
+                        unsigned region_count) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    memset(ring, 0, sizeof(*ring));
+    
+    ring->fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd < 0) {
+        return false;
+    }
+    
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_ring_size > ring->sq_ring_size) {
+            ring->sq_ring_size = ring->cq_ring_size;
+        }
+        ring->sq_ring = uring_map(ring, ring->sq_ring_size, IORING_OFF_SQ_RING);
+        ring->cq_ring = ring->sq_ring;
+    } else {
+        ring->sq_ring = uring_map(ring, ring->sq_ring_size, IORING_OFF_SQ_RING);
+        ring->cq_ring = uring_map(ring, ring->cq_ring_size, IORING_OFF_CQ_RING);
+    }
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = uring_map(ring, ring->sqes_size, IORING_OFF_SQES);
+    if (ring->sq_ring == NULL || ring->cq_ring == NULL || ring->sqes == NULL) {
+        uring_teardown(ring);
+        return false;
+    }
+    
+    unsigned char *sq = ring->sq_ring;
+    unsigned char *cq = ring->cq_ring;
+    ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sq_mask = *(unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+    ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cq_mask = *(unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    
+    // Registration pins the buffers, which RLIMIT_MEMLOCK can refuse
+    if (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_BUFFERS,
+                regions, region_count) != 0) {
+        uring_teardown(ring);
+        return false;
+    }
+    return true;
+}
+
+// Queue a fixed-buffer read or write; offset -1 means the file position.
+// The ring has room for every operation the engine keeps in flight.
+static void uring_queue(uring *ring, uint8_t opcode, int fd, const unsigned char *buf,
+                        size_t len, uint64_t offset, unsigned buf_index, uint64_t user_data) {
+    unsigned tail = *ring->sq_tail;
+    unsigned index = tail & ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)buf;
+    sqe->len = (uint32_t)len;
+    sqe->off = offset;
+    sqe->buf_index = (uint16_t)buf_index;
+    sqe->user_data = user_data;
+    ring->sq_array[index] = index;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ring->to_submit++;
+}
+
+// Issue (or continue, after a short read) the read filling one slot
+static void uring_read_slot(uring *ring, uring_input *in, unsigned index, unsigned slot) {
+    uint64_t offset = in->seekable
+        ? in->base + in->slot_chunk[slot] * URING_CHUNK + in->filled[slot]
+        : (uint64_t)-1;
+    uring_queue(ring, IORING_OP_READ_FIXED, in->fd,
+                in->buffers + slot * (size_t)URING_CHUNK + in->filled[slot],
+                in->want[slot] - in->filled[slot], offset, index,
+                ((uint64_t)index << 8) | slot);
+    in->in_flight++;
+}
+
+// Start reads for upcoming chunks whose slots have been consumed
+static void uring_start_reads(uring *ring, uring_input *inputs, uint64_t xor_next) {
+    for (unsigned i = 0; i < 2; i++) {
+        uring_input *in = &inputs[i];
+        while (in->next_read < in->end_chunk && in->next_read < xor_next + URING_DEPTH &&
+               (in->seekable || in->in_flight == 0)) {
+            unsigned slot = (unsigned)(in->next_read % URING_DEPTH);
+            in->slot_chunk[slot] = in->next_read;
+            in->filled[slot] = 0;
+            in->want[slot] = span_in_file(in->size, in->next_read * URING_CHUNK, URING_CHUNK);
+            uring_read_slot(ring, in, i, slot);
+            in->next_read++;
+        }
+    }
+}
+
+static void uring_read_done(uring *ring, uring_input *in, unsigned index, unsigned slot, int res) {
+    in->in_flight--;
+    if (res < 0) {
+        die("read error", EXIT_ERROR);
+    }
+    
+    in->filled[slot] += (size_t)res;
+    in->stream->consumed += (uint64_t)res;
+    if (res == 0 && in->seekable && in->filled[slot] < in->want[slot]) {
+        die("input file shrank while reading", EXIT_ERROR);
+    }
+    if (res == 0) {
+        // End of a pipe or device: this chunk is its last
+        in->end_chunk = in->slot_chunk[slot] + (in->filled[slot] > 0 ? 1 : 0);
+        in->ready[slot] = true;
+    } else if (in->filled[slot] < in->want[slot]) {
+        uring_read_slot(ring, in, index, slot);
+    } else {
+        in->ready[slot] = true;
+    }
+}
+
+// Queue a run of output bytes: data from an output slot, or zeros
+static void uring_push_write(uring_output *out, const unsigned char *data, uint64_t len, int slot) {
+    uring_write *w = &out->queue[(out->queue_head + out->queue_len) % URING_QUEUE];
+    w->data = data;
+    w->len = len;
+    w->offset = out->next_offset;
+    w->slot = slot;
+    out->queue_len++;
+    if (out->seekable) {
+        out->next_offset += len;
+    }
+}
+
+// Submit queued output in order, carving zero runs into buffer-sized writes
+static void uring_start_writes(uring *ring, uring_output *out) {
+    while (out->queue_len > 0 && out->in_flight < (out->seekable ? URING_WRITES : 1)) {
+        uring_write *next = &out->queue[out->queue_head];
+        unsigned id = 0;
+        while (out->active[id].len > 0) {
+            id++;
+        }
+        
+        uring_write *w = &out->active[id];
+        *w = *next;
+        if (next->data == NULL) {
+            w->data = out->zeros;
+            w->len = (next->len < URING_CHUNK) ? next->len : URING_CHUNK;
+            w->slot = -1;
+        }
+        next->len -= w->len;
+        next->offset += out->seekable ? w->len : 0;
+        if (next->len == 0) {
+            out->queue_head = (out->queue_head + 1) % URING_QUEUE;
+            out->queue_len--;
+        }
+        
+        unsigned buf_index = (w->data == out->zeros) ? URING_ZERO_REGION : URING_OUTPUT_REGION;
+        uring_queue(ring, IORING_OP_WRITE_FIXED, out->fd, w->data, (size_t)w->len,
+                    out->seekable ? w->offset : (uint64_t)-1, buf_index, URING_WRITE | id);
+        out->in_flight++;
+    }
+}
+
+static void uring_write_done(uring *ring, uring_output *out, unsigned id, int res) {
+    uring_write *w = &out->active[id];
+    out->in_flight--;
+    if (res <= 0) {
+        die("write error", EXIT_ERROR);
+    }
+    
+    w->data += res;
+    w->offset += (uint64_t)res;
+    w->len -= (uint64_t)res;
+    if (w->len > 0) {
+        // Short write: send the rest before anything queued behind it
+        unsigned buf_index = (w->slot < 0) ? URING_ZERO_REGION : URING_OUTPUT_REGION;
+        uring_queue(ring, IORING_OP_WRITE_FIXED, out->fd, w->data, (size_t)w->len,
+                    out->seekable ? w->offset : (uint64_t)-1, buf_index, URING_WRITE | id);
+        out->in_flight++;
+    } else if (w->slot >= 0) {
+        out->busy[w->slot] = false;
+    }
+}
+
+static void uring_open_input(uring_input *in, input_stream *stream, unsigned char *buffers) {
+    struct stat st;
+    memset(in, 0, sizeof(*in));
+    in->stream = stream;
+    in->fd = fileno(stream->stream);
+    in->buffers = buffers;
+    in->end_chunk = UINT64_MAX;
+    
+    off_t start = lseek(in->fd, 0, SEEK_CUR);
+    in->size = stream->limit;
+    if (fstat(in->fd, &st) == 0 && S_ISREG(st.st_mode) && start >= 0 && start <= st.st_size) {
+        in->seekable = true;
+        in->base = (uint64_t)start;
+        if ((uint64_t)(st.st_size - start) < in->size) {
+            in->size = (uint64_t)(st.st_size - start);
+        }
+    }
+    if (in->size != UINT64_MAX) {
+        in->end_chunk = (in->size + URING_CHUNK - 1) / URING_CHUNK;
+    }
+}
+
+// Returns false, before touching any input, when io_uring is unavailable
+static bool xor_uring(input_stream *in1, input_stream *in2, output_state *out,
+                      uint64_t *bytes_processed) {
+    unsigned char *buffers;
+    size_t region = (size_t)URING_DEPTH * URING_CHUNK;
+    if (posix_memalign((void **)&buffers, PIPELINE_ALIGN, 3 * region + URING_CHUNK) != 0) {
+        die("memory allocation failed", EXIT_ERROR);
+    }
+    memset(buffers + 3 * region, 0, URING_CHUNK);
+    
+    struct iovec regions[4] = {
+        { buffers, region },
+        { buffers + region, region },
+        { buffers + 2 * region, region },
+        { buffers + 3 * region, URING_CHUNK },
+    };
+    uring ring;
+    if (!uring_setup(&ring, URING_ENTRIES, regions, 4)) {
+        free(buffers);
+        return false;
+    }
+    
+    uring_input inputs[2];
+    uring_open_input(&inputs[0], in1, buffers);
+    uring_open_input(&inputs[1], in2, buffers + region);
+    
+    uring_output *uout = calloc(1, sizeof(*uout));
+    if (uout == NULL) {
+        die("memory allocation failed", EXIT_ERROR);
+    }
+    struct stat st;
+    uout->fd = fileno(out->stream);
+    uout->buffers = buffers + 2 * region;
+    uout->zeros = buffers + 3 * region;
+    off_t start = lseek(uout->fd, 0, SEEK_CUR);
+    if (fstat(uout->fd, &st) == 0 && S_ISREG(st.st_mode) && start >= 0 &&
+        !(fcntl(uout->fd, F_GETFL) & O_APPEND)) {
+        uout->seekable = true;
+        uout->next_offset = (uint64_t)start;
+    }
+    
+    uint64_t xor_next = 0;
+    uint64_t next_report = PROGRESS_INTERVAL;
+    bool done = false;
+    *bytes_processed = 0;
+    
+    while (!done || uout->queue_len > 0 || uout->in_flight > 0) {
+        // XOR every chunk whose inputs have arrived and whose slot is free
+        while (!done) {
+            unsigned slot = (unsigned)(xor_next % URING_DEPTH);
+            uring_input *a = &inputs[0];
+            uring_input *b = &inputs[1];
+            bool past_a = xor_next >= a->end_chunk;
+            bool past_b = xor_next >= b->end_chunk;
+            if ((!past_a && !a->ready[slot]) || (!past_b && !b->ready[slot]) ||
+                uout->busy[slot] || uout->queue_len + 2 > URING_QUEUE) {
+                break;
+            }
+            
+            size_t len1 = past_a ? 0 : a->filled[slot];
+            size_t len2 = past_b ? 0 : b->filled[slot];
+            size_t max_len = (len1 > len2) ? len1 : len2;
+            if (max_len == 0) {
+                done = true;
+                break;
+            }
+            
+            unsigned char *result = uout->buffers + slot * (size_t)URING_CHUNK;
+            uint64_t started = stats_clock();
+            size_t data_len = xor_chunk(result, a->buffers + slot * (size_t)URING_CHUNK, len1,
+                                        b->buffers + slot * (size_t)URING_CHUNK, len2);
+            stats_add(&stats.compute_ns, started);
+            
+            // The same trailing-zero holdback as emit_chunk()
+            if (data_len > 0) {
+                if (out->pending_zeros > 0) {
+                    uring_push_write(uout, NULL, out->pending_zeros, -1);
+                    out->bytes_written += out->pending_zeros;
+                    out->pending_zeros = 0;
+                }
+                uring_push_write(uout, result, data_len, (int)slot);
+                uout->busy[slot] = true;
+                out->bytes_written += data_len;
+            }
+            out->pending_zeros += max_len - data_len;
+            
+            a->ready[slot] = false;
+            b->ready[slot] = false;
+            xor_next++;
+            *bytes_processed += max_len;
+            report_progress(*bytes_processed, &next_report);
+        }
+        
+        if (!done) {
+            uring_start_reads(&ring, inputs, xor_next);
+        }
+        uring_start_writes(&ring, uout);
+        
+        unsigned in_flight = inputs[0].in_flight + inputs[1].in_flight + uout->in_flight;
+        if (in_flight == 0) {
+            continue;  // Nothing to wait for; the XOR stage can move on
+        }
+        // Waiting while reads are outstanding is waiting on input
+        uint64_t started = stats_clock();
+        if (uring_enter(&ring, 1) < 0) {
+            die("io_uring submission failed", EXIT_ERROR);
+        }
+        stats_add((inputs[0].in_flight + inputs[1].in_flight > 0) ? &stats.read_ns : &stats.write_ns, started);
+        
+        unsigned head = *ring.cq_head;
+        unsigned tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            struct io_uring_cqe *cqe = &ring.cqes[head & ring.cq_mask];
+            uint64_t user_data = cqe->user_data;
+            if (user_data & URING_WRITE) {
+                uring_write_done(&ring, uout, (unsigned)(user_data & 0xFF), cqe->res);
+            } else {
+                unsigned index = (unsigned)(user_data >> 8);
+                uring_read_done(&ring, &inputs[index], index, (unsigned)(user_data & 0xFF), cqe->res);
+            }
+        }
+        __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+    }
+    
+    // Leave a regular-file output positioned after what was written
+    if (uout->seekable) {
+        lseek(uout->fd, (off_t)uout->next_offset, SEEK_SET);
+    }
+    
+    uring_teardown(&ring);
+    free(uout);
+    free(buffers);
+    return true;
+}
+#else
+static bool xor_uring(input_stream *in1, input_stream *in2, output_state *out,
+                      uint64_t *bytes_processed) {
+    (void)in1;
+    (void)in2;
+    (void)out;
+    (void)bytes_processed;
+    return false;
+}
+#endif
+
+static void xor_files(const char *const *files, const struct stat *sts, size_t count) {
+    const char *file1 = files[0];
+    const char *file2 = files[1];
+    const struct stat *st1 = &sts[0];
+    const struct stat *st2 = &sts[1];
+    
+    // Check if waiting for stdin input
+    int stdin_count = 0;
+    for (size_t k = 0; k < count; k++) {
+        if (strcmp(files[k], "-") == 0) stdin_count++;
+    }
+    
+    if (stdin_count == 1 && isatty(STDIN_FILENO)) {
+        progress("waiting for input from stdin...");
+    }
+    
+    char progress_msg[256];
+    int out_fd = STDOUT_FILENO;
+    if (output_file != NULL) {
+        out_fd = open(output_file, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        if (out_fd < 0) {
+            char error_msg[256];
+            snprintf(error_msg, sizeof(error_msg), "cannot open output file %s: %s",
+                    output_file, strerror(errno));
+            die(error_msg, EXIT_ERROR);
+        }
+        
+        // Whole regular files on both sides can be split across worker
+        // threads, unless a single-threaded run asked for another engine
+        struct stat out_st;
+        if (count == 2 && (jobs > 1 || (io_mode == IO_MMAP && !use_splice)) && S_ISREG(st1->st_mode) && (S_ISREG(st2->st_mode) || cyclic_key != NULL) &&
+            !operand_has_range(file1) && (cyclic_key != NULL || !operand_has_range(file2)) &&
+            fstat(out_fd, &out_st) == 0 && S_ISREG(out_st.st_mode)) {
+            snprintf(progress_msg, sizeof(progress_msg), "XORing %s and %s into %s (%s kernel, %ld threads)",
+                    file1, file2, output_file, xor_kernel_name(), jobs);
+            progress(progress_msg);
+            
+            uint64_t total = ((uint64_t)st1->st_size > (uint64_t)st2->st_size || cyclic_key != NULL)
+                ? (uint64_t)st1->st_size : (uint64_t)st2->st_size;
+            uint64_t bytes_read[2];
+            uint64_t data_end = xor_parallel(file1, (uint64_t)st1->st_size,
+                                             file2, (uint64_t)st2->st_size, out_fd, bytes_read);
+            uint64_t out_size = preserve_zeros ? total : data_end;
+            if (ftruncate(out_fd, (off_t)out_size) != 0) {
+                die("cannot truncate output file", EXIT_ERROR);
+            }
+            if (close(out_fd) != 0) {
+                die("write error", EXIT_ERROR);
+            }
+            
+            stats.engine = "parallel";
+            stats.threads = jobs;
+            stats.input_bytes[0] = bytes_read[0];
+            if (cyclic_key == NULL) {
+                stats.input_bytes[1] = bytes_read[1];
+            }
+            stats.bytes_processed = total;
+            stats.bytes_written = out_size;
+            
+            const char *zero_msg = preserve_zeros ? "preserved" : "after stripping trailing zeros";
+            snprintf(progress_msg, sizeof(progress_msg), 
+                    "XOR complete: %" PRIu64 " bytes processed, %" PRIu64 " bytes %s", 
+                    total, out_size, zero_msg);
+            progress(progress_msg);
+            return;
+        }
+    }
+    
+    // The repeating key has already been read from file2
+    size_t open_count = (cyclic_key != NULL) ? 1 : count;
+    input_stream *inputs = calloc(count, sizeof(*inputs));
+    if (inputs == NULL) {
+        die("memory allocation failed", EXIT_ERROR);
+    }
+    for (size_t k = 0; k < count; k++) {
+        snprintf(progress_msg, sizeof(progress_msg), "reading file%zu: %s", k + 1,
+                strcmp(files[k], "-") == 0 ? "stdin" : files[k]);
+        progress(progress_msg);
+        if (k < open_count) {
+            open_input_stream(&inputs[k], files[k]);
+        }
+    }
+    input_stream *in1 = &inputs[0];
+    input_stream *in2 = &inputs[1];
+    
+    if (isatty(out_fd)) {
+        progress("warning: output going to terminal (consider redirecting to file)");
+    }
+    
+    output_state out = { stdout, 0, 0, NULL, -1, 0 };
+    if (out_fd != STDOUT_FILENO) {
+        out.stream = fdopen(out_fd, "wb");
+        if (out.stream == NULL) {
+            die("memory allocation failed", EXIT_ERROR);
+        }
+        
+        // The uring engine keeps its own holdback
+        struct stat out_st;
+        if ((io_mode != IO_URING || count > 2) && fstat(out_fd, &out_st) == 0 && S_ISREG(out_st.st_mode)) {
+            out.truncate_fd = out_fd;
+        }
+    }
+    
+    if (cyclic_key != NULL && xor_key_length(cyclic_key) == 0) {
+        snprintf(progress_msg, sizeof(progress_msg), "XORing with a ChaCha20 keystream (%s kernel, %s keystream kernel)",
+                xor_kernel_name(), xor_keystream_kernel_name());
+    } else if (cyclic_key != NULL) {
+        snprintf(progress_msg, sizeof(progress_msg), "XORing with a %zu byte repeating key (%s kernel%s)",
+                xor_key_length(cyclic_key), xor_kernel_name(),
+                xor_key_in_registers(cyclic_key) ? ", key in registers" : "");
+    } else if (count > 2) {
+        snprintf(progress_msg, sizeof(progress_msg), "XORing %zu input streams in one pass (%s kernel)",
+                count, xor_kernel_name());
+    } else {
+        snprintf(progress_msg, sizeof(progress_msg), "XORing input streams (%s kernel, %s engine)",
+                xor_kernel_name(), io_engine_names[io_mode]);
+    }
+    progress(progress_msg);
+    
+    // Only the serial engines hand their buffers to a pipe
+    if (use_splice && (io_mode == IO_MMAP || io_mode == IO_STDIO || count > 2)) {
+#if XOR_SPLICE
+        out.splice = open_splice_output(out_fd);
+#endif
+        if (out.splice == NULL) {
+            progress("output is not a pipe that supports vmsplice, writing normally");
+        } else {
+            snprintf(progress_msg, sizeof(progress_msg), "splicing output into a %zu byte pipe",
+                    out.splice->pipe_size);
+            progress(progress_msg);
+        }
+    }
+    
+    // Only the mmap engine maps inputs; the serial loops read the rest
+    // through stdio
+    uint64_t bytes_processed;
+    stats.engine = io_engine_names[(io_mode == IO_MMAP) ? IO_MMAP : IO_STDIO];
+    stats.threads = 1;
+    if (cyclic_key != NULL) {
+        bytes_processed = xor_repeat_serial(in1, &out);
+    } else if (count > 2) {
+        bytes_processed = xor_multi_serial(inputs, count, &out);
+    } else if (io_mode == IO_PIPELINE) {
+        stats.engine = io_engine_names[IO_PIPELINE];
+        stats.threads = 4;  // Two readers, the XOR stage and a writer
+        bytes_processed = xor_pipeline(in1, in2, &out);
+    } else if (io_mode == IO_URING && xor_uring(in1, in2, &out, &bytes_processed)) {
+        stats.engine = io_engine_names[IO_URING];
+    } else {
+        if (io_mode == IO_URING) {
+            progress("io_uring unavailable, falling back to stdio");
+        }
+        bytes_processed = xor_serial(in1, in2, &out);
+    }
+    
+    // Trailing zeros are only written out when asked to preserve them
+    if (preserve_zeros) {
+        write_zeros(&out, out.pending_zeros);
+        out.pending_zeros = 0;
+    }
+    if (fflush(out.stream) != 0) {
+        die("write error", EXIT_ERROR);
+    }
+    if (out.truncate_fd >= 0 && !preserve_zeros) {
+        if (ftruncate(out.truncate_fd, (off_t)out.data_end) != 0) {
+            die("cannot truncate output file", EXIT_ERROR);
+        }
+        out.bytes_written = out.data_end;
+    }
+    for (size_t k = 0; k < open_count; k++) {
+        stats.input_bytes[k] = inputs[k].consumed;
+    }
+    stats.bytes_processed = bytes_processed;
+    stats.bytes_written = out.bytes_written;
+    
+    // Progress message
+    const char *zero_msg = preserve_zeros ? "preserved" : "after stripping trailing zeros";
+    snprintf(progress_msg, sizeof(progress_msg), 
+            "XOR complete: %" PRIu64 " bytes processed, %" PRIu64 " bytes %s", 
+            bytes_processed, out.bytes_written, zero_msg);
+    progress(progress_msg);
+    
+    // Cleanup
+    for (size_t k = 0; k < open_count; k++) {
+        close_input_stream(&inputs[k]);
+    }
+    free(inputs);
+#if XOR_SPLICE
+    if (out.splice != NULL) {
+        close_splice_output(out.splice);
+    }
+#endif
+    if (out.stream != stdout && fclose(out.stream) != 0) {
+        die("write error", EXIT_ERROR);
+    }
+}
+
+// Parity files. A little-endian header records the set and the original
+// length of every data file, so a rebuilt file comes back at exactly its
+// old size whatever zeros it ended in:
+//   magic[8] data_count:u32 parity_count:u32 parity_index:u32 reserved:u32
+//   lengths:u64[data_count]
+// It is padded to PARITY_ALIGN, and the parity bytes follow, as long as
+// the longest data file.
+static void store_le(unsigned char *p, uint64_t value, size_t bytes) {
+    for (size_t i = 0; i < bytes; i++) {
+        p[i] = (unsigned char)(value >> (8 * i));
+    }
+}
+
+static uint64_t load_le(const unsigned char *p, size_t bytes) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < bytes; i++) {
+        value |= (uint64_t)p[i] << (8 * i);
+    }
+    return value;
+}
+
+static uint64_t parity_header_size(size_t data_count) {
+    uint64_t size = PARITY_FIXED_HEADER + 8 * (uint64_t)data_count;
+    return (size + PARITY_ALIGN - 1) / PARITY_ALIGN * PARITY_ALIGN;
+}
+
+static void write_parity_header(int fd, const parity_header *header) {
+    size_t size = (size_t)header->data_offset;
+    unsigned char *buf = calloc(1, size);
+    if (buf == NULL) {
+        die("memory allocation failed", EXIT_ERROR);
+    }
+    memcpy(buf, PARITY_MAGIC, 8);
+    store_le(buf + 8, header->data_count, 4);
+    store_le(buf + 12, header->parity_count, 4);
+    store_le(buf + 16, header->parity_index, 4);
+    for (uint32_t k = 0; k < header->data_count; k++) {
+        store_le(buf + PARITY_FIXED_HEADER + 8 * (size_t)k, header->lengths[k], 8);
+    }
+    pwrite_full(fd, buf, size, 0);
+    free(buf);
+}
+
+static void read_parity_header(int fd, const char *filename, parity_header *header) {
+    char error_msg[256];
+    unsigned char fixed[PARITY_FIXED_HEADER];
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (uint64_t)st.st_size < PARITY_FIXED_HEADER ||
+        pread(fd, fixed, sizeof(fixed), 0) != (ssize_t)sizeof(fixed) ||
+        memcmp(fixed, PARITY_MAGIC, 8) != 0) {
+        snprintf(error_msg, sizeof(error_msg), "not a parity file: %s", filename);
+        die(error_msg, EXIT_USAGE);
+    }
+    
+    header->data_count = (uint32_t)load_le(fixed + 8, 4);
+    header->parity_count = (uint32_t)load_le(fixed + 12, 4);
+    header->parity_index = (uint32_t)load_le(fixed + 16, 4);
+    if (header->data_count < 2 || header->data_count > MAX_INPUTS ||
+        header->parity_count < 1 || header->parity_count > MAX_PARITY ||
+        header->data_count + header->parity_count > 256 ||
+        header->parity_index >= header->parity_count) {
+        snprintf(error_msg, sizeof(error_msg), "unsupported parity file: %s", filename);
+        die(error_msg, EXIT_USAGE);
+    }
+    header->data_offset = parity_header_size(header->data_count);
+    if ((uint64_t)st.st_size < header->data_offset) {
+        snprintf(error_msg, sizeof(error_msg), "parity file is truncated: %s", filename);
+        die(error_msg, EXIT_ERROR);
+    }
+    
+    unsigned char *lengths = malloc(8 * (size_t)header->data_count);
+    header->lengths = malloc(header->data_count * sizeof(*header->lengths));
+    if (lengths == NULL || header->lengths == NULL) {
+        die("memory allocation failed", EXIT_ERROR);
+    }
+    pread_full(fd, lengths, 8 * (size_t)header->data_count, PARITY_FIXED_HEADER);
+    header->length = 0;
+    for (uint32_t k = 0; k < header->data_count; k++) {
+        header->lengths[k] = load_le(lengths + 8 * (size_t)k, 8);
+        if (header->lengths[k] > header->length) {
+            header->length = header->lengths[k];
+        }
+    }
+    free(lengths);
+    if ((uint64_t)st.st_size != header->data_offset + header->length) {
+        snprintf(error_msg, sizeof(error_msg), "parity file is truncated: %s", filename);
+        die(error_msg, EXIT_ERROR);
+    }
+}
+
+// Reed-Solomon over GF(2^8). Parity row r of a k+m set has coefficient
+// y / (r + y) for data file j, with y = m + j: a Cauchy matrix with each
+// column scaled so row 0 is all ones. Every square submatrix of a Cauchy
+// matrix is invertible, so any k of the k+m files determine the rest, and
+// row 0 is the plain XOR parity written when m is 1.
+static unsigned char rs_coefficient(size_t row, size_t col, size_t parity_count) {
+    unsigned char y = (unsigned char)(parity_count + col);
+    return xor_gf_div(y, (unsigned char)(row ^ y));
+}
+
+// Invert the n x n matrix m in place by Gauss-Jordan elimination
+static void gf_invert(unsigned char *m, size_t n) {
+    unsigned char *inv = calloc(n * n, 1);
+    if (inv == NULL) {
+        die("memory allocation failed", EXIT_ERROR);
+    }
+    for (size_t i = 0; i < n; i++) {
+        inv[i * n + i] = 1;
+    }
+    for (size_t col = 0; col < n; col++) {
+        size_t pivot = col;
+        while (pivot < n && m[pivot * n + col] == 0) {
+            pivot++;
+        }
+        if (pivot == n) {
+            die("parity files are inconsistent", EXIT_ERROR);
+        }
+        for (size_t j = 0; j < n; j++) {
+            unsigned char t = m[col * n + j];
+            m[col * n + j] = m[pivot * n + j];
+            m[pivot * n + j] = t;
+            t = inv[col * n + j];
+            inv[col * n + j] = inv[pivot * n + j];
+            inv[pivot * n + j] = t;
+        }
+        unsigned char scale = xor_gf_div(1, m[col * n + col]);
+        for (size_t j = 0; j < n; j++) {
+            m[col * n + j] = xor_gf_mul(m[col * n + j], scale);
+            inv[col * n + j] = xor_gf_mul(inv[col * n + j], scale);
+        }
+        for (size_t i = 0; i < n; i++) {
+            unsigned char f = m[i * n + col];
+            if (i == col || f == 0) {
+                continue;
+            }
+            for (size_t j = 0; j < n; j++) {
+                m[i * n + j] ^= xor_gf_mul(f, m[col * n + j]);
+                inv[i * n + j] ^= xor_gf_mul(f, inv[col * n + j]);
+            }
+        }
+    }
+    memcpy(m, inv, n * n);
+    free(inv);
+}
+
+// Stripe workers: each claims a PARALLEL_CHUNK stripe of the outputs and
+// reads the matching range of every input, CHUNK_SIZE at a time, then
+// combines them into each output in turn. Inputs shorter than the stripe
+// are zero-padded.
+static void *stripe_worker_main(void *arg) {
+    stripe_job *job = arg;
+    unsigned char *buffers;
+    if (posix_memalign((void **)&buffers, PIPELINE_ALIGN, (job->in_count + 1) * (size_t)CHUNK_SIZE) != 0) {
+        die("memory allocation failed", EXIT_ERROR);
+    }
+    unsigned char *result = buffers + job->in_count * (size_t)CHUNK_SIZE;
+    
+    while (!interrupted) {
+        uint64_t index = __atomic_fetch_add(&job->next_chunk, 1, __ATOMIC_RELAXED);
+        if (index >= (job->length + PARALLEL_CHUNK - 1) / PARALLEL_CHUNK) {
+            break;
+        }
+        uint64_t stripe = index * PARALLEL_CHUNK;
+        size_t stripe_len = span_in_file(job->length, stripe, PARALLEL_CHUNK);
+        
+        for (size_t done = 0; done < stripe_len; done += CHUNK_SIZE) {
+            uint64_t offset = stripe + done;
+            size_t len = (stripe_len - done < CHUNK_SIZE) ? stripe_len - done : CHUNK_SIZE;
+            const unsigned char *src[MAX_INPUTS];
+            size_t which[MAX_INPUTS];
+            size_t active = 0;
+            for (size_t k = 0; k < job->in_count; k++) {
+                size_t in_len = span_in_file(job->in_lengths[k], offset, len);
+                if (in_len == 0) {
+                    continue;
+                }
+                unsigned char *buf = buffers + k * CHUNK_SIZE;
+                pread_full(job->in_fds[k], buf, in_len, job->in_offsets[k] + offset);
+                memset(buf + in_len, 0, len - in_len);
+                which[active] = k;
+                src[active++] = buf;
+            }
+            
+            for (size_t o = 0; o < job->out_count; o++) {
+                size_t out_len = span_in_file(job->out_lengths[o], offset, len);
+                if (out_len == 0) {
+                    continue;
+                }
+                if (job->xor_rows[o] && active > 0) {
+                    xor_buffers_multi(result, src, active, out_len);
+                } else {
+                    memset(result, 0, out_len);
+                    for (size_t a = 0; a < active; a++) {
+                        size_t at = o * job->in_count + which[a];
+                        if (job->coefs[at] == 1) {
+                            xor_buffers(result, result, src[a], out_len);
+                        } else if (job->coefs[at] != 0) {
+                            xor_gf_mul_add(result, src[a], job->tables + 32 * at, out_len);
+                        }
+                    }
+                }
+                pwrite_full(job->out_fds[o], result, out_len, job->out_offsets[o] + offset);
+            }
+        }
+        
+        uint64_t total = __atomic_add_fetch(&job->bytes_done, stripe_len, __ATOMIC_RELAXED);
+        if (show_progress && total / PROGRESS_INTERVAL != (total - stripe_len) / PROGRESS_INTERVAL) {
+            char progress_msg[256];
+            snprintf(progress_msg, sizeof(progress_msg), "processed %" PRIu64 " bytes", total);
+            progress(progress_msg);
+        }
+    }
+    
+    free(buffers);
+    return NULL;
+}
+
+static void run_stripes(stripe_job *job) {
+    size_t cells = job->out_count * job->in_count;
+    job->tables = malloc(32 * cells);
+    job->xor_rows = malloc(job->out_count * sizeof(*job->xor_rows));
+    pthread_t *threads = calloc((size_t)jobs, sizeof(*threads));
+    if (job->tables == NULL || job->xor_rows == NULL || threads == NULL) {
+        die("memory allocation failed", EXIT_ERROR);
+    }
+    job->length = 0;
+    for (size_t o = 0; o < job->out_count; o++) {
+        job->xor_rows[o] = true;
+        for (size_t k = 0; k < job->in_count; k++) {
+            unsigned char c = job->coefs[o * job->in_count + k];
+            xor_gf_tables(c, job->tables + 32 * (o * job->in_count + k));
+            job->xor_rows[o] = job->xor_rows[o] && c == 1;
+        }
+        if (job->out_lengths[o] > job->length) {
+            job->length = job->out_lengths[o];
+        }
+        preallocate_output(job->out_fds[o], job->out_offsets[o] + job->out_lengths[o]);
+    }
+    
+    for (long i = 0; i < jobs; i++) {
+        if (pthread_create(&threads[i], NULL, stripe_worker_main, job) != 0) {
+            die("cannot start worker threads", EXIT_ERROR);
+        }
+    }
+    for (long i = 0; i < jobs; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    for (size_t o = 0; o < job->out_count; o++) {
+        if (ftruncate(job->out_fds[o], (off_t)(job->out_offsets[o] + job->out_lengths[o])) != 0) {
+            die("cannot truncate output file", EXIT_ERROR);
+        }
+    }
+    free(job->tables);
+    free(job->xor_rows);
+}
+
+// Room for in_count inputs and out_count outputs
+static void alloc_stripe_job(stripe_job *job, size_t in_count, size_t out_count) {
+    memset(job, 0, sizeof(*job));
+    job->in_fds = calloc(in_count, sizeof(*job->in_fds));
+    job->in_offsets = calloc(in_count, sizeof(*job->in_offsets));
+    job->in_lengths = calloc(in_count, sizeof(*job->in_lengths));
+    job->out_fds = calloc(out_count, sizeof(*job->out_fds));
+    job->out_offsets = calloc(out_count, sizeof(*job->out_offsets));
+    job->out_lengths = calloc(out_count, sizeof(*job->out_lengths));
+    job->coefs = calloc(in_count * out_count, 1);
+    if (job->in_fds == NULL || job->in_offsets == NULL || job->in_lengths == NULL ||
+        job->out_fds == NULL || job->out_offsets == NULL || job->out_lengths == NULL ||
+        job->coefs == NULL) {
+        die("memory allocation failed", EXIT_ERROR);
+    }
+}
+
+static void free_stripe_job(stripe_job *job) {
+    for (size_t k = 0; k < job->in_count; k++) {
+        close(job->in_fds[k]);
+    }
+    for (size_t o = 0; o < job->out_count; o++) {
+        if (close(job->out_fds[o]) != 0) {
+            die("write error", EXIT_ERROR);
+        }
+    }
+    free(job->in_fds);
+    free(job->in_offsets);
+    free(job->in_lengths);
+    free(job->out_fds);
+    free(job->out_offsets);
+    free(job->out_lengths);
+    free(job->coefs);
+}
+
+// Seed from the kernel's random pool, falling back to /dev/urandom
+static void random_seed(unsigned char *buf, size_t len) {
+    size_t got = 0;
+#if XOR_GETRANDOM
+    while (got < len) {
+        ssize_t n = getrandom(buf + got, len - got, 0);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        got += (size_t)n;
+    }
+#endif
+    if (got < len) {
+        int fd = open("/dev/urandom", O_RDONLY);
+        if (fd < 0 || read_full(fd, buf, len) != len) {
+            die("cannot read a random seed", EXIT_ERROR);
+        }
+        close(fd);
+    }
+}
+
+static int open_data_file(const char *filename, uint64_t *size) {
+    struct stat st;
+    int fd = open_input_fd(filename);
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        char error_msg[256];
+        snprintf(error_msg, sizeof(error_msg), "not a regular file: %s", filename);
+        die(error_msg, EXIT_USAGE);
+    }
+    *size = (uint64_t)st.st_size;
+    return fd;
+}
+
+static int create_output_file(const char *filename, int flags) {
+    int fd = open(filename, O_WRONLY | O_CREAT | flags, 0666);
+    if (fd < 0) {
+        char error_msg[256];
+        snprintf(error_msg, sizeof(error_msg), "cannot open output file %s: %s",
+                filename, strerror(errno));
+        die(error_msg, EXIT_ERROR);
+    }
+    return fd;
+}
+
+// A set of one parity file is just PARITY; larger sets are PARITY.1 to
+// PARITY.m
+static char *parity_file_name(const char *base, size_t index, size_t parity_count) {
+    size_t size = strlen(base) + 16;
+    char *name = malloc(size);
+    if (name == NULL) {
+        die("memory allocation failed", EXIT_ERROR);
+    }
+    if (parity_count == 1) {
+        snprintf(name, size, "%s", base);
+    } else {
+        snprintf(name, size, "%s.%zu", base, index + 1);
+    }
+    return name;
+}
+
+// xor parity [-m M] PARITY DATA...
+static void parity_command(const char *parity_file, const char *const *data_files, size_t count,
+                           size_t parity_count) {
+    char progress_msg[256];
+    if (count < 2) {
+        die("parity needs at least two data files", EXIT_USAGE);
+    }
+    if (count > MAX_INPUTS) {
+        die("too many input files", EXIT_USAGE);
+    }
+    if (count + parity_count > 256) {
+        die("at most 256 data and parity files in one set", EXIT_USAGE);
+    }
+    
+    parity_header header;
+    memset(&header, 0, sizeof(header));
+    header.data_count = (uint32_t)count;
+    header.parity_count = (uint32_t)parity_count;
+    header.data_offset = parity_header_size(count);
+    header.lengths = calloc(count, sizeof(*header.lengths));
+    char **names = calloc(parity_count, sizeof(*names));
+    if (header.lengths == NULL || names == NULL) {
+        die("memory allocation failed", EXIT_ERROR);
+    }
+    for (size_t p = 0; p < parity_count; p++) {
+        names[p] = parity_file_name(parity_file, p, parity_count);
+    }
+    
+    stripe_job job;
+    alloc_stripe_job(&job, count, parity_count);
+    for (size_t k = 0; k < count; k++) {
+        for (size_t p = 0; p < parity_count; p++) {
+            if (is_same_file(data_files[k], names[p])) {
+                die("cannot use a data file as the parity file", EXIT_USAGE);
+            }
+        }
+        job.in_fds[k] = open_data_file(data_files[k], &job.in_lengths[k]);
+        header.lengths[k] = job.in_lengths[k];
+        if (header.lengths[k] > header.length) {
+            header.length = header.lengths[k];
+        }
+    }
+    job.in_count = count;
+    
+    for (size_t p = 0; p < parity_count; p++) {
+        job.out_fds[p] = create_output_file(names[p], O_TRUNC);
+        job.out_offsets[p] = header.data_offset;
+        job.out_lengths[p] = header.length;
+        for (size_t k = 0; k < count; k++) {
+            job.coefs[p * count + k] = rs_coefficient(p, k, parity_count);
+        }
+        header.parity_index = (uint32_t)p;
+        write_parity_header(job.out_fds[p], &header);
+    }
+    job.out_count = parity_count;
+    if (parity_count == 1) {
+        snprintf(progress_msg, sizeof(progress_msg), "writing parity of %zu files to %s (%s kernel, %ld threads)",
+                count, parity_file, xor_kernel_name(), jobs);
+    } else {
+        snprintf(progress_msg, sizeof(progress_msg),
+                "writing %zu parity files for %zu files to %s.* (%s and %s kernels, %ld threads)",
+                parity_count, count, parity_file, xor_kernel_name(), xor_gf_kernel_name(), jobs);
+    }
+    progress(progress_msg);
+    
+    run_stripes(&job);
+    free_stripe_job(&job);
+    
+    snprintf(progress_msg, sizeof(progress_msg), "parity complete: %" PRIu64 " bytes", header.length);
+    progress(progress_msg);
+    for (size_t p = 0; p < parity_count; p++) {
+        free(names[p]);
+    }
+    free(names);
+    free(header.lengths);
+}
+
+// Open whichever files of the parity set named by base survive: base
+// itself, or else base.1 to base.m. fds[p] is -1 for a missing one.
+static size_t open_parity_set(const char *base, int *fds, parity_header *header) {
+    char error_msg[256];
+    if (access(base, F_OK) == 0) {
+        int fd = open_input_fd(base);
+        read_parity_header(fd, base, header);
+        for (size_t p = 0; p < header->parity_count; p++) {
+            fds[p] = -1;
+        }
+        fds[header->parity_index] = fd;
+        return 1;
+    }
+    
+    size_t found = 0;
+    size_t parity_count = MAX_PARITY;
+    for (size_t p = 0; p < parity_count; p++) {
+        char *name = parity_file_name(base, p, MAX_PARITY);
+        fds[p] = -1;
+        if (access(name, F_OK) == 0) {
+            parity_header member;
+            fds[p] = open_input_fd(name);
+            read_parity_header(fds[p], name, &member);
+            if (found == 0) {
+                *header = member;
+                parity_count = member.parity_count;
+            } else {
+                bool same = member.data_count == header->data_count &&
+                            member.parity_count == header->parity_count;
+                for (uint32_t k = 0; same && k < member.data_count; k++) {
+                    same = member.lengths[k] == header->lengths[k];
+                }
+                free(member.lengths);
+                if (!same) {
+                    snprintf(error_msg, sizeof(error_msg), "%s belongs to a different parity set", name);
+                    die(error_msg, EXIT_USAGE);
+                }
+            }
+            if (member.parity_index != p) {
+                snprintf(error_msg, sizeof(error_msg), "%s belongs to a different parity set", name);
+                die(error_msg, EXIT_USAGE);
+            }
+            found++;
+        }
+        free(name);
+    }
+    if (found == 0) {
+        open_input_fd(base);  // Reports the missing file
+    }
+    return found;
+}
+
+// xor rebuild PARITY DATA...: recreate up to m missing data files, and
+// then any missing parity files of the set
+static void rebuild_command(const char *parity_file, const char *const *data_files, size_t count) {
+    char error_msg[256];
+    int parity_fds[MAX_PARITY];
+    parity_header header;
+    bool whole_set = access(parity_file, F_OK) != 0;
+    size_t parity_found = open_parity_set(parity_file, parity_fds, &header);
+    size_t parity_count = header.parity_count;
+    if (count != header.data_count) {
+        snprintf(error_msg, sizeof(error_msg), "parity file covers %" PRIu32 " data files, %zu given",
+                header.data_count, count);
+        die(error_msg, EXIT_USAGE);
+    }
+    
+    // Number the survivors as inputs and the missing files as outputs
+    size_t missing[MAX_INPUTS];
+    size_t missing_count = 0;
+    size_t survivors[MAX_INPUTS];
+    size_t survivor_count = 0;
+    for (size_t k = 0; k < count; k++) {
+        if (access(data_files[k], F_OK) != 0) {
+            missing[missing_count++] = k;
+        } else {
+            survivors[survivor_count++] = k;
+        }
+    }
+    size_t rows[MAX_PARITY];
+    size_t row_count = 0;
+    size_t lost_parity[MAX_PARITY];
+    size_t lost_parity_count = 0;
+    for (size_t p = 0; p < parity_count; p++) {
+        if (parity_fds[p] < 0) {
+            if (whole_set) {
+                lost_parity[lost_parity_count++] = p;
+            }
+        } else if (row_count < missing_count) {
+            rows[row_count++] = p;
+        } else {
+            close(parity_fds[p]);
+        }
+    }
+    if (missing_count == 0 && lost_parity_count == 0) {
+        die("nothing to rebuild: every file exists", EXIT_USAGE);
+    }
+    if (missing_count > parity_found) {
+        snprintf(error_msg, sizeof(error_msg), "cannot rebuild %zu missing files from %zu parity files",
+                missing_count, parity_found);
+        die(error_msg, EXIT_USAGE);
+    }
+    
+    stripe_job job;
+    alloc_stripe_job(&job, survivor_count + row_count, missing_count + lost_parity_count);
+    size_t in_count = survivor_count + row_count;
+    for (size_t s = 0; s < survivor_count; s++) {
+        size_t k = survivors[s];
+        job.in_fds[s] = open_data_file(data_files[k], &job.in_lengths[s]);
+        if (job.in_lengths[s] != header.lengths[k]) {
+            snprintf(error_msg, sizeof(error_msg), "%s is %" PRIu64 " bytes, but the parity file recorded %" PRIu64,
+                    data_files[k], job.in_lengths[s], header.lengths[k]);
+            die(error_msg, EXIT_USAGE);
+        }
+    }
+    for (size_t r = 0; r < row_count; r++) {
+        job.in_fds[survivor_count + r] = parity_fds[rows[r]];
+        job.in_offsets[survivor_count + r] = header.data_offset;
+        job.in_lengths[survivor_count + r] = header.length;
+    }
+    job.in_count = in_count;
+    
+    // Row r of the parity says sum(A[r][j] * missing j) = P[r] +
+    // sum(A[r][s] * survivor s), so inverting A over the rows used and the
+    // missing columns gives each missing file in terms of the inputs
+    if (missing_count > 0) {
+        unsigned char *a = malloc(missing_count * missing_count);
+        if (a == NULL) {
+            die("memory allocation failed", EXIT_ERROR);
+        }
+        for (size_t r = 0; r < row_count; r++) {
+            for (size_t t = 0; t < missing_count; t++) {
+                a[r * missing_count + t] = rs_coefficient(rows[r], missing[t], parity_count);
+            }
+        }
+        gf_invert(a, missing_count);
+        for (size_t t = 0; t < missing_count; t++) {
+            unsigned char *coefs = job.coefs + t * in_count;
+            for (size_t r = 0; r < row_count; r++) {
+                unsigned char b = a[t * missing_count + r];
+                coefs[survivor_count + r] = b;
+                for (size_t s = 0; s < survivor_count; s++) {
+                    coefs[s] ^= xor_gf_mul(b, rs_coefficient(rows[r], survivors[s], parity_count));
+                }
+            }
+        }
+        free(a);
+    }
+    // A lost parity file is its row applied to the survivors and to the
+    // missing files as just expressed
+    for (size_t q = 0; q < lost_parity_count; q++) {
+        unsigned char *coefs = job.coefs + (missing_count + q) * in_count;
+        for (size_t s = 0; s < survivor_count; s++) {
+            coefs[s] = rs_coefficient(lost_parity[q], survivors[s], parity_count);
+        }
+        for (size_t t = 0; t < missing_count; t++) {
+            unsigned char c = rs_coefficient(lost_parity[q], missing[t], parity_count);
+            for (size_t i = 0; i < in_count; i++) {
+                coefs[i] ^= xor_gf_mul(c, job.coefs[t * in_count + i]);
+            }
+        }
+    }
+    
+    for (size_t t = 0; t < missing_count; t++) {
+        const char *name = data_files[missing[t]];
+        job.out_fds[t] = create_output_file(name, O_EXCL);
+        job.out_lengths[t] = header.lengths[missing[t]];
+        snprintf(error_msg, sizeof(error_msg), "rebuilding %s (%" PRIu64 " bytes, %s kernel, %ld threads)",
+                name, job.out_lengths[t], xor_kernel_name(), jobs);
+        progress(error_msg);
+    }
+    for (size_t q = 0; q < lost_parity_count; q++) {
+        char *name = parity_file_name(parity_file, lost_parity[q], parity_count);
+        size_t o = missing_count + q;
+        job.out_fds[o] = create_output_file(name, O_EXCL);
+        job.out_offsets[o] = header.data_offset;
+        job.out_lengths[o] = header.length;
+        header.parity_index = (uint32_t)lost_parity[q];
+        write_parity_header(job.out_fds[o], &header);
+        snprintf(error_msg, sizeof(error_msg), "rebuilding %s (%" PRIu64 " bytes, %s kernel, %ld threads)",
+                name, job.out_lengths[o], xor_gf_kernel_name(), jobs);
+        progress(error_msg);
+        free(name);
+    }
+    job.out_count = missing_count + lost_parity_count;
+    
+    run_stripes(&job);
+    free_stripe_job(&job);
+    progress("rebuild complete");
+    free(header.lengths);
+}
+
+// Keygen workers: each claims a PARALLEL_CHUNK of the key and pwrites it
+static void *keygen_worker_main(void *arg) {
+    keygen_job *job = arg;
+    unsigned char *buf;
+    if (posix_memalign((void **)&buf, PIPELINE_ALIGN, PARALLEL_CHUNK) != 0) {
+        die("memory allocation failed", EXIT_ERROR);
+    }
+    
+    while (!interrupted) {
+        uint64_t index = __atomic_fetch_add(&job->next_chunk, 1, __ATOMIC_RELAXED);
+        uint64_t offset = index * PARALLEL_CHUNK;
+        if (offset >= job->size) {
+            break;
+        }
+        size_t len = span_in_file(job->size, offset, PARALLEL_CHUNK);
+        xor_keystream_fill(job->ks, offset, buf, len);
+        pwrite_full(job->fd, buf, len, job->base + offset);
+        
+        uint64_t total = __atomic_add_fetch(&job->bytes_done, len, __ATOMIC_RELAXED);
+        if (show_progress && total / PROGRESS_INTERVAL != (total - len) / PROGRESS_INTERVAL) {
+            char progress_msg[256];
+            snprintf(progress_msg, sizeof(progress_msg), "generated %" PRIu64 " bytes", total);
+            progress(progress_msg);
+        }
+    }
+    
+    free(buf);
+    return NULL;
+}
+
+// xor --keygen SIZE: SIZE bytes of ChaCha20 keystream from a fresh random
+// seed. Threads each write their own ranges when the output is a regular
+// file; anything else is written in order.
+static void keygen_command(uint64_t size) {
+    char progress_msg[256];
+    unsigned char seed[XOR_KEYSTREAM_SEED];
+    random_seed(seed, sizeof(seed));
+    xor_keystream ks;
+    xor_keystream_init(&ks, seed, sizeof(seed));
+    memset(seed, 0, sizeof(seed));
+    
+    int out_fd = STDOUT_FILENO;
+    if (output_file != NULL) {
+        out_fd = create_output_file(output_file, O_TRUNC);
+    }
+    if (isatty(out_fd)) {
+        progress("warning: output going to terminal (consider redirecting to file)");
+    }
+    
+    struct stat st;
+    off_t base = lseek(out_fd, 0, SEEK_CUR);
+    int flags = fcntl(out_fd, F_GETFL);
+    if (jobs > 1 && fstat(out_fd, &st) == 0 && S_ISREG(st.st_mode) && base >= 0 &&
+        flags >= 0 && !(flags & O_APPEND)) {
+        snprintf(progress_msg, sizeof(progress_msg), "generating %" PRIu64 " bytes of keystream (%s kernel, %ld threads)",
+                size, xor_keystream_kernel_name(), jobs);
+        progress(progress_msg);
+        
+        keygen_job job = { &ks, out_fd, (uint64_t)base, size, 0, 0 };
+        preallocate_output(out_fd, job.base + size);
+        pthread_t *threads = calloc((size_t)jobs, sizeof(*threads));
+        if (threads == NULL) {
+            die("memory allocation failed", EXIT_ERROR);
+        }
+        for (long i = 0; i < jobs; i++) {
+            if (pthread_create(&threads[i], NULL, keygen_worker_main, &job) != 0) {
+                die("cannot start worker threads", EXIT_ERROR);
+            }
+        }
+        for (long i = 0; i < jobs; i++) {
+            pthread_join(threads[i], NULL);
+        }
+        free(threads);
+        
+        // Leave the descriptor where a sequential writer would have
+        if (output_file != NULL && ftruncate(out_fd, (off_t)(job.base + size)) != 0) {
+            die("cannot truncate output file", EXIT_ERROR);
+        }
+        lseek(out_fd, (off_t)(job.base + size), SEEK_SET);
+    } else {
+        snprintf(progress_msg, sizeof(progress_msg), "generating %" PRIu64 " bytes of keystream (%s kernel)",
+                size, xor_keystream_kernel_name());
+        progress(progress_msg);
+        
+        output_state out = { stdout, 0, 0, NULL, -1, 0 };
+        if (out_fd != STDOUT_FILENO) {
+            out.stream = fdopen(out_fd, "wb");
+            if (out.stream == NULL) {
+                die("memory allocation failed", EXIT_ERROR);
+            }
+        }
+        if (use_splice) {
+#if XOR_SPLICE
+            out.splice = open_splice_output(out_fd);
+#endif
+            if (out.splice == NULL) {
+                progress("output is not a pipe that supports vmsplice, writing normally");
+            }
+        }
+        unsigned char *buf;
+        if (posix_memalign((void **)&buf, PIPELINE_ALIGN, PIPELINE_CHUNK) != 0) {
+            die("memory allocation failed", EXIT_ERROR);
+        }
+        uint64_t next_report = PROGRESS_INTERVAL;
+        for (uint64_t offset = 0; offset < size && !interrupted; ) {
+            // A pipe takes the keystream in ring buffers it can vmsplice
+            unsigned char *dst = buf;
+            size_t len = span_in_file(size, offset, PIPELINE_CHUNK);
+#if XOR_SPLICE
+            if (out.splice != NULL) {
+                dst = splice_buffer(out.splice);
+                len = span_in_file(size, offset, CHUNK_SIZE);
+            }
+#endif
+            xor_keystream_fill(&ks, offset, dst, len);
+            write_output(&out, dst, len);
+            offset += len;
+            if (show_progress && offset >= next_report) {
+                snprintf(progress_msg, sizeof(progress_msg), "generated %" PRIu64 " bytes", offset);
+                progress(progress_msg);
+                next_report = offset - offset % PROGRESS_INTERVAL + PROGRESS_INTERVAL;
+            }
+        }
+        if (fflush(out.stream) != 0) {
+            die("write error", EXIT_ERROR);
+        }
+        free(buf);
+#if XOR_SPLICE
+        if (out.splice != NULL) {
+            close_splice_output(out.splice);
+        }
+#endif
+        if (out.stream != stdout && fclose(out.stream) != 0) {
+            die("write error", EXIT_ERROR);
+        }
+        out_fd = STDOUT_FILENO;
+    }
+    if (out_fd != STDOUT_FILENO && close(out_fd) != 0) {
+        die("write error", EXIT_ERROR);
+    }
+    memset(&ks, 0, sizeof(ks));
+    
+    snprintf(progress_msg, sizeof(progress_msg), "keygen complete: %" PRIu64 " bytes", size);
+    progress(progress_msg);
+}
+
+// Open operand as a batch input: a regular file, cut down to any
+// @OFFSET:LENGTH range. Failures are recorded in in->error, not fatal.
+static void batch_open_input(batch_input *in, const char *operand) {
+    memset(in, 0, sizeof(*in));
+    byte_range range;
+    char *path = operand_path(operand, &range);
+    struct stat st;
+    in->fd = open(path, O_RDONLY);
+    if (in->fd < 0) {
+        snprintf(in->error, sizeof(in->error), "cannot open %s: %s", path, strerror(errno));
+    } else if (fstat(in->fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        snprintf(in->error, sizeof(in->error), "not a regular file: %s", path);
+        close(in->fd);
+        in->fd = -1;
+    } else {
+        in->dev = st.st_dev;
+        in->ino = st.st_ino;
+        in->offset = range.offset;
+        in->size = ((uint64_t)st.st_size > range.offset) ? (uint64_t)st.st_size - range.offset : 0;
+        if (in->size > range.length) {
+            in->size = range.length;
+        }
+        in->ok = true;
+    }
+    free(path);
+}
+
+// Map the range of an open batch input for sharing between jobs
+static void batch_map_input(batch_input *in) {
+    if (in->size == 0) {
+        in->data = zero_chunk;
+    } else {
+        uint64_t start = in->offset - in->offset % (uint64_t)sysconf(_SC_PAGESIZE);
+        in->map_len = (size_t)(in->offset + in->size - start);
+        in->map = mmap(NULL, in->map_len, PROT_READ, MAP_SHARED, in->fd, (off_t)start);
+        if (in->map == MAP_FAILED) {
+            in->map = NULL;
+            snprintf(in->error, sizeof(in->error), "cannot map shared input: %s", strerror(errno));
+            in->ok = false;
+            return;
+        }
+        in->data = in->map + (in->offset - start);
+    }
+    close(in->fd);
+    in->fd = -1;
+}
+
+// Expand the range of a batch input as a --repeat-key key
+static void batch_load_key(batch_input *in) {
+    if (in->size == 0 || in->size > XOR_KEY_MAX) {
+        snprintf(in->error, sizeof(in->error), in->size == 0 ? "key file is empty"
+                                                             : "key too long for --repeat-key");
+        in->ok = false;
+        return;
+    }
+    if (in->data != NULL) {
+        in->key = expand_key(in->data, (size_t)in->size);
+        return;
+    }
+    unsigned char *key = malloc((size_t)in->size);
+    if (key == NULL) {
+        die("memory allocation failed", EXIT_ERROR);
+    }
+    pread_full(in->fd, key, (size_t)in->size, in->offset);
+    in->key = expand_key(key, (size_t)in->size);
+    free(key);
+}
+
+static void batch_close_input(batch_input *in) {
+    if (in->key != NULL) {
+        xor_key_free(in->key);
+    }
+    if (in->map != NULL) {
+        munmap(in->map, in->map_len);
+    }
+    if (in->fd >= 0) {
+        close(in->fd);
+    }
+}
+
+// len bytes of a batch input at offset within its range, short past its
+// end: straight from the shared mapping, or read into buf
+static const unsigned char *batch_read(const batch_input *in, uint64_t offset, size_t len,
+                                       unsigned char *buf, size_t *got) {
+    *got = span_in_file(in->size, offset, len);
+    if (in->data != NULL) {
+        return (*got > 0) ? in->data + offset : zero_chunk;
     }
+    pread_full(in->fd, buf, *got, in->offset + offset);
+    return buf;
 }
 
-static FILE *open_input_stream(const char *filename) {
-    if (filename == NULL || strcmp(filename, "-") == 0) {
-        return stdin;
+// Run one batch job with the worker's three PARALLEL_CHUNK buffers.
+// Returns false with error set if it could not be started.
+static bool batch_run(const batch_job *batch, const batch_entry *entry, unsigned char *buffers,
+                      char *error, size_t error_len, uint64_t *bytes) {
+    batch_input local[2];
+    const batch_input *inputs[2];
+    bool opened[2] = { false, false };
+    bool ok = true;
+    for (size_t k = 0; k < 2 && ok; k++) {
+        if (entry->shared[k] != NULL) {
+            inputs[k] = entry->shared[k];
+        } else {
+            batch_open_input(&local[k], entry->operands[k]);
+            opened[k] = true;
+            if (k == 1 && batch->keyed && local[k].ok) {
+                batch_load_key(&local[k]);
+            }
+            inputs[k] = &local[k];
+        }
+        if (!inputs[k]->ok) {
+            snprintf(error, error_len, "%s", inputs[k]->error);
+            ok = false;
+        }
     }
     
-    FILE *fp = fopen(filename, "rb");
-    if (fp == NULL) {
-        if (errno == ENOENT) {
-            die("file not found", EXIT_USAGE);
-        } else if (errno == EACCES) {
-            die("permission denied", EXIT_USAGE);
-        } else {
-            char error_msg[256];
-            snprintf(error_msg, sizeof(error_msg), "cannot open %s: %s", 
-                    filename, strerror(errno));
-            die(error_msg, EXIT_ERROR);
+    // Opened without O_TRUNC so that an input named as the output is
+    // caught before it is emptied
+    int fd = -1;
+    struct stat st;
+    if (ok) {
+        fd = open(entry->operands[2], O_WRONLY | O_CREAT, 0666);
+        if (fd < 0) {
+            snprintf(error, error_len, "cannot open output file %s: %s",
+                    entry->operands[2], strerror(errno));
+            ok = false;
+        } else if (fstat(fd, &st) != 0 ||
+                   (st.st_dev == inputs[0]->dev && st.st_ino == inputs[0]->ino) ||
+                   (st.st_dev == inputs[1]->dev && st.st_ino == inputs[1]->ino)) {
+            snprintf(error, error_len, "cannot use an input file as the output");
+            ok = false;
+        } else if (ftruncate(fd, 0) != 0) {
+            snprintf(error, error_len, "cannot truncate output file %s: %s",
+                    entry->operands[2], strerror(errno));
+            ok = false;
         }
     }
     
-    return fp;
+    // All-zero pieces are not written, leaving holes that the final
+    // truncation keeps or cuts off
+    uint64_t total = 0;
+    uint64_t data_end = 0;
+    if (ok) {
+        uint64_t skip2 = entry->range2.offset;
+        uint64_t size2 = (inputs[1]->size > skip2) ? inputs[1]->size - skip2 : 0;
+        if (size2 > entry->range2.length) {
+            size2 = entry->range2.length;
+        }
+        total = (batch->keyed || batch->mirror || inputs[0]->size > size2) ? inputs[0]->size
+                                                                           : size2;
+        unsigned char *result = buffers + 2 * (size_t)PARALLEL_CHUNK;
+        for (uint64_t offset = 0; offset < total && !interrupted; offset += PARALLEL_CHUNK) {
+            size_t len = span_in_file(total, offset, PARALLEL_CHUNK);
+            size_t len1, len2;
+            const unsigned char *data1 = batch_read(inputs[0], offset, len, buffers, &len1);
+            size_t data_len;
+            if (batch->keyed) {
+                data_len = xor_key_apply(inputs[1]->key, result, data1, len, skip2 + offset);
+            } else {
+                const unsigned char *data2 = batch_read(inputs[1], skip2 + offset,
+                                                        span_in_file(size2, offset, len),
+                                                        buffers + PARALLEL_CHUNK, &len2);
+                data_len = xor_chunk(result, data1, len1, data2, len2);
+            }
+            if (data_len > 0) {
+                pwrite_full(fd, result, data_len, offset);
+                data_end = offset + data_len;
+            }
+        }
+        if (ftruncate(fd, (off_t)(preserve_zeros || batch->mirror ? total : data_end)) != 0) {
+            die("cannot truncate output file", EXIT_ERROR);
+        }
+    }
+    if (fd >= 0 && close(fd) != 0) {
+        die("write error", EXIT_ERROR);
+    }
+    for (size_t k = 0; k < 2; k++) {
+        if (opened[k]) {
+            batch_close_input(&local[k]);
+        }
+    }
+    *bytes = total;
+    return ok;
 }
 
-static void xor_files(const char *file1, const char *file2) {
-    // Check if waiting for stdin input
-    int stdin_count = 0;
-    if (strcmp(file1, "-") == 0) stdin_count++;
-    if (strcmp(file2, "-") == 0) stdin_count++;
+// Take a job from the head of deque, or with steal from its tail.
+// Returns false once it is empty.
+static bool batch_take(batch_deque *deque, bool steal, size_t *index) {
+    uint64_t range = __atomic_load_n(&deque->range, __ATOMIC_RELAXED);
+    for (;;) {
+        uint64_t head = range >> 32;
+        uint64_t tail = range & 0xffffffffu;
+        if (head >= tail) {
+            return false;
+        }
+        uint64_t next = steal ? (head << 32 | (tail - 1)) : ((head + 1) << 32 | tail);
+        if (__atomic_compare_exchange_n(&deque->range, &range, next, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            *index = steal ? tail - 1 : head;
+            return true;
+        }
+    }
+}
+
+// Batch workers run their own jobs in manifest order, then steal from the
+// other workers in turn, so a few huge files do not hold up the small ones
+// queued behind them. Jobs are never added, so an empty sweep means done.
+static void *batch_worker_main(void *arg) {
+    batch_worker *worker = arg;
+    batch_job *batch = worker->batch;
+    unsigned char *buffers;
+    if (posix_memalign((void **)&buffers, PIPELINE_ALIGN, 3 * (size_t)PARALLEL_CHUNK) != 0) {
+        die("memory allocation failed", EXIT_ERROR);
+    }
     
-    if (stdin_count == 1 && isatty(STDIN_FILENO)) {
-        progress("waiting for input from stdin...");
+    while (!interrupted) {
+        size_t index;
+        bool found = batch_take(&batch->deques[worker->index], false, &index);
+        for (size_t i = 1; i < batch->workers && !found; i++) {
+            found = batch_take(&batch->deques[(worker->index + i) % batch->workers], true, &index);
+        }
+        if (!found) {
+            break;
+        }
+        
+        const batch_entry *entry = &batch->entries[index];
+        char error[512];
+        uint64_t bytes;
+        if (!batch_run(batch, entry, buffers, error, sizeof(error), &bytes)) {
+            if (entry->line > 0) {
+                fprintf(stderr, "%s: line %zu: %s\n", PROG_NAME, entry->line, error);
+            } else {
+                fprintf(stderr, "%s: %s\n", PROG_NAME, error);
+            }
+            __atomic_add_fetch(&batch->jobs_failed, 1, __ATOMIC_RELAXED);
+        }
+        __atomic_add_fetch(&batch->bytes_done, bytes, __ATOMIC_RELAXED);
+        uint64_t done = __atomic_add_fetch(&batch->jobs_done, 1, __ATOMIC_RELAXED);
+        if (show_progress && done % 1000 == 0) {
+            char progress_msg[256];
+            snprintf(progress_msg, sizeof(progress_msg), "finished %" PRIu64 " of %zu jobs",
+                    done, batch->count);
+            progress(progress_msg);
+        }
     }
     
+    free(buffers);
+    return NULL;
+}
+
+static int compare_operands(const void *a, const void *b) {
+    return strcmp(**(const char *const *const *)a, **(const char *const *const *)b);
+}
+
+// Run the jobs of batch on the worker pool. Inputs that more than one job
+// names, and that are not shared already, are opened and mapped once first.
+static void run_batch(batch_job *batch) {
     char progress_msg[256];
-    snprintf(progress_msg, sizeof(progress_msg), "reading file1: %s", 
-            strcmp(file1, "-") == 0 ? "stdin" : file1);
-    progress(progress_msg);
-    FILE *stream1 = open_input_stream(file1);
     
-    snprintf(progress_msg, sizeof(progress_msg), "reading file2: %s", 
-            strcmp(file2, "-") == 0 ? "stdin" : file2);
-    progress(progress_msg);
-    FILE *stream2 = open_input_stream(file2);
+    // Sort the inputs by name to find the ones named more than once
+    const char **operands = malloc((2 * batch->count + 1) * sizeof(*operands));
+    const char ***sorted = malloc((2 * batch->count + 1) * sizeof(*sorted));
+    if (operands == NULL || sorted == NULL) {
+        die("memory allocation failed", EXIT_ERROR);
+    }
+    size_t sorted_count = 0;
+    for (size_t i = 0; i < 2 * batch->count; i++) {
+        const batch_entry *entry = &batch->entries[i / 2];
+        operands[i] = entry->operands[i % 2];
+        if (entry->shared[i % 2] == NULL) {
+            sorted[sorted_count++] = &operands[i];
+        }
+    }
+    qsort(sorted, sorted_count, sizeof(*sorted), compare_operands);
+    size_t shared_count = 0;
+    batch_input **shared = NULL;
+    for (size_t i = 0; i < sorted_count; ) {
+        size_t j = i + 1;
+        bool as_key = false;
+        while (j < sorted_count && strcmp(*sorted[j], *sorted[i]) == 0) {
+            j++;
+        }
+        for (size_t k = i; k < j; k++) {
+            as_key = as_key || (batch->keyed && (sorted[k] - operands) % 2 == 1);
+        }
+        if (j - i > 1) {
+            batch_input *input = malloc(sizeof(*input));
+            shared = realloc(shared, (shared_count + 1) * sizeof(*shared));
+            if (input == NULL || shared == NULL) {
+                die("memory allocation failed", EXIT_ERROR);
+            }
+            shared[shared_count++] = input;
+            batch_open_input(input, *sorted[i]);
+            if (input->ok) {
+                batch_map_input(input);
+            }
+            if (input->ok && as_key) {
+                batch_load_key(input);
+            }
+            for (size_t k = i; k < j; k++) {
+                size_t slot = (size_t)(sorted[k] - operands);
+                batch->entries[slot / 2].shared[slot % 2] = input;
+            }
+        }
+        i = j;
+    }
+    free(sorted);
+    free(operands);
     
-    if (isatty(STDOUT_FILENO)) {
-        progress("warning: output going to terminal (consider redirecting to file)");
+    // Deal the jobs out to the workers in contiguous runs
+    batch->workers = (size_t)jobs < batch->count ? (size_t)jobs : batch->count;
+    if (batch->workers == 0) {
+        batch->workers = 1;
+    }
+    batch->deques = calloc(batch->workers, sizeof(*batch->deques));
+    batch_worker *workers = calloc(batch->workers, sizeof(*workers));
+    if (batch->deques == NULL || workers == NULL) {
+        die("memory allocation failed", EXIT_ERROR);
+    }
+    for (size_t w = 0; w < batch->workers; w++) {
+        uint64_t head = batch->count * w / batch->workers;
+        uint64_t tail = batch->count * (w + 1) / batch->workers;
+        batch->deques[w].range = head << 32 | tail;
     }
     
-    // Buffer for collecting all output data
-    unsigned char *all_data = NULL;
-    size_t total_size = 0;
-    size_t bytes_processed = 0;
+    snprintf(progress_msg, sizeof(progress_msg), "running %zu jobs (%zu shared inputs, %s kernel, %zu threads)",
+            batch->count, shared_count, xor_kernel_name(), batch->workers);
+    progress(progress_msg);
+    for (size_t w = 0; w < batch->workers; w++) {
+        workers[w].batch = batch;
+        workers[w].index = w;
+        if (pthread_create(&workers[w].thread, NULL, batch_worker_main, &workers[w]) != 0) {
+            die("cannot start worker threads", EXIT_ERROR);
+        }
+    }
+    for (size_t w = 0; w < batch->workers; w++) {
+        pthread_join(workers[w].thread, NULL);
+    }
     
-    progress("XORing input streams");
+    for (size_t i = 0; i < shared_count; i++) {
+        batch_close_input(shared[i]);
+        free(shared[i]);
+    }
+    free(shared);
+    free(workers);
+    free(batch->deques);
+}
+
+// xor --batch MANIFEST: each line is INPUT1 INPUT2 OUTPUT, and blank lines
+// and lines starting with # are skipped. An input named on more than one
+// line is opened and mapped once, up front, and shared by those jobs.
+// A job that cannot start is reported with its line number and the rest
+// carry on; the exit status is nonzero if any failed.
+static void batch_command(const char *manifest, bool keyed) {
+    char progress_msg[256];
+    input_stream in;
+    open_input_stream(&in, manifest);
+    char *text = NULL;
+    size_t len = 0;
+    for (;;) {
+        unsigned char chunk[CHUNK_SIZE];
+        const unsigned char *data;
+        size_t n = read_input(&in, chunk, CHUNK_SIZE, &data);
+        if (n == 0) {
+            break;
+        }
+        text = realloc(text, len + n + 1);
+        if (text == NULL) {
+            die("memory allocation failed", EXIT_ERROR);
+        }
+        memcpy(text + len, data, n);
+        len += n;
+    }
+    if (input_error(&in)) {
+        die("read error", EXIT_ERROR);
+    }
+    close_input_stream(&in);
     
-    while (!interrupted) {
-        unsigned char chunk1[CHUNK_SIZE];
-        unsigned char chunk2[CHUNK_SIZE];
-        
-        size_t read1 = fread(chunk1, 1, CHUNK_SIZE, stream1);
-        size_t read2 = fread(chunk2, 1, CHUNK_SIZE, stream2);
-        
-        if (read1 == 0 && read2 == 0) {
-            break;  // Both streams exhausted
+    // Split the manifest into fields in place
+    batch_job batch;
+    memset(&batch, 0, sizeof(batch));
+    batch.keyed = keyed;
+    size_t capacity = 0;
+    size_t line = 0;
+    for (char *p = text; p != NULL && p < text + len; ) {
+        char *eol = memchr(p, '\n', (size_t)(text + len - p));
+        char *next = (eol != NULL) ? eol + 1 : NULL;
+        if (eol == NULL) {
+            eol = text + len;
         }
+        *eol = '\0';
+        line++;
         
-        // Pad shorter chunk with zeros
-        size_t max_len = (read1 > read2) ? read1 : read2;
-        if (read1 < max_len) {
-            memset(chunk1 + read1, 0, max_len - read1);
+        char *fields[4];
+        size_t count = 0;
+        for (char *save, *field = strtok_r(p, " \t\r", &save); field != NULL && count < 4;
+             field = strtok_r(NULL, " \t\r", &save)) {
+            fields[count++] = field;
         }
-        if (read2 < max_len) {
-            memset(chunk2 + read2, 0, max_len - read2);
+        p = next;
+        if (count == 0 || fields[0][0] == '#') {
+            continue;
         }
-        
-        // XOR the chunks
-        unsigned char *result_chunk = malloc(max_len);
-        if (result_chunk == NULL) {
-            die("memory allocation failed", EXIT_ERROR);
+        if (count != 3) {
+            snprintf(progress_msg, sizeof(progress_msg),
+                    "manifest line %zu: expected INPUT1 INPUT2 OUTPUT", line);
+            die(progress_msg, EXIT_USAGE);
         }
-        
-        for (size_t i = 0; i < max_len; i++) {
-            result_chunk[i] = chunk1[i] ^ chunk2[i];
+        if (strcmp(fields[0], "-") == 0 || strcmp(fields[1], "-") == 0 ||
+            strcmp(fields[2], "-") == 0) {
+            snprintf(progress_msg, sizeof(progress_msg),
+                    "manifest line %zu: batch jobs cannot use stdin or stdout", line);
+            die(progress_msg, EXIT_USAGE);
         }
-        
-        // Append to all_data buffer
-        all_data = realloc(all_data, total_size + max_len);
-        if (all_data == NULL) {
+        if (batch.count == capacity) {
+            capacity = capacity ? 2 * capacity : 1024;
+            batch.entries = realloc(batch.entries, capacity * sizeof(*batch.entries));
+            if (batch.entries == NULL) {
+                die("memory allocation failed", EXIT_ERROR);
+            }
+        }
+        batch_entry *entry = &batch.entries[batch.count++];
+        memset(entry, 0, sizeof(*entry));
+        for (size_t k = 0; k < 3; k++) {
+            entry->operands[k] = fields[k];
+        }
+        entry->line = line;
+        entry->range2.length = UINT64_MAX;
+    }
+    if (batch.count > UINT32_MAX) {
+        die("too many jobs in the manifest", EXIT_USAGE);
+    }
+    
+    run_batch(&batch);
+    free(batch.entries);
+    free(text);
+    
+    snprintf(progress_msg, sizeof(progress_msg), "batch complete: %zu jobs, %" PRIu64 " bytes",
+            batch.count, batch.bytes_done);
+    progress(progress_msg);
+    if (batch.jobs_failed > 0) {
+        snprintf(progress_msg, sizeof(progress_msg), "%" PRIu64 " of %zu batch jobs failed",
+                batch.jobs_failed, batch.count);
+        die(progress_msg, EXIT_ERROR);
+    }
+}
+
+static void tree_push(tree_walk *walk, char *path) {
+    pthread_mutex_lock(&walk->lock);
+    if (walk->dir_count == walk->dir_capacity) {
+        walk->dir_capacity = walk->dir_capacity ? 2 * walk->dir_capacity : 64;
+        walk->dirs = realloc(walk->dirs, walk->dir_capacity * sizeof(*walk->dirs));
+        if (walk->dirs == NULL) {
             die("memory allocation failed", EXIT_ERROR);
         }
-        memcpy(all_data + total_size, result_chunk, max_len);
-        total_size += max_len;
-        bytes_processed += max_len;
+    }
+    walk->dirs[walk->dir_count++] = path;
+    pthread_cond_signal(&walk->wake);
+    pthread_mutex_unlock(&walk->lock);
+}
+
+static void tree_failure(tree_walk *walk, const char *what, const char *path) {
+    fprintf(stderr, "%s: %s %s: %s\n", PROG_NAME, what, path[0] ? path : ".", strerror(errno));
+    __atomic_add_fetch(&walk->failures, 1, __ATOMIC_RELAXED);
+}
+
+// Look at one entry of directory dir_fd, which is parent under SRC_DIR:
+// queue a subdirectory after creating its mirror, or record a regular
+// file. Symlinks and special files are left out.
+static void tree_visit(tree_walker *walker, int dir_fd, const char *parent, const char *name) {
+    tree_walk *walk = walker->walk;
+    if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+        return;
+    }
+    size_t parent_len = strlen(parent);
+    char *path = malloc(parent_len + strlen(name) + 2);
+    if (path == NULL) {
+        die("memory allocation failed", EXIT_ERROR);
+    }
+    sprintf(path, parent_len ? "%s/%s" : "%s%s", parent, name);
+    
+    struct stat st;
+    if (fstatat(dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+        tree_failure(walk, "cannot stat", path);
+    } else if (S_ISDIR(st.st_mode)) {
+        if (st.st_dev == walk->out_dev && st.st_ino == walk->out_ino) {
+            // OUT_DIR itself, when it lies inside SRC_DIR
+        } else if (mkdirat(walk->out_fd, path, 0777) != 0 && errno != EEXIST) {
+            tree_failure(walk, "cannot create directory", path);
+        } else {
+            tree_push(walk, path);
+            return;
+        }
+    } else if (S_ISREG(st.st_mode)) {
+        if (walker->count == walker->capacity) {
+            walker->capacity = walker->capacity ? 2 * walker->capacity : 1024;
+            walker->files = realloc(walker->files, walker->capacity * sizeof(*walker->files));
+            if (walker->files == NULL) {
+                die("memory allocation failed", EXIT_ERROR);
+            }
+        }
+        walker->files[walker->count].path = path;
+        walker->files[walker->count].size = (uint64_t)st.st_size;
+        walker->count++;
+        return;
+    }
+    free(path);
+}
+
+// Read one directory under SRC_DIR. On Linux the entries come straight
+// from getdents64 in large batches rather than one readdir() at a time.
+static void tree_read_dir(tree_walker *walker, const char *path) {
+    tree_walk *walk = walker->walk;
+    int fd = openat(walk->src_fd, path[0] ? path : ".", O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+    if (fd < 0) {
+        tree_failure(walk, "cannot open directory", path);
+        return;
+    }
+#if XOR_GETDENTS
+    unsigned char buf[DIRENT_BUFFER] __attribute__((aligned(8)));
+    for (;;) {
+        long n = syscall(SYS_getdents64, fd, buf, sizeof(buf));
+        if (n <= 0) {
+            if (n < 0) {
+                tree_failure(walk, "cannot read directory", path);
+            }
+            break;
+        }
+        for (long pos = 0; pos < n; ) {
+            const struct dirent64 *entry = (const struct dirent64 *)(buf + pos);
+            pos += entry->d_reclen;
+            tree_visit(walker, fd, path, entry->d_name);
+        }
+    }
+    close(fd);
+#else
+    DIR *dir = fdopendir(fd);
+    if (dir == NULL) {
+        tree_failure(walk, "cannot read directory", path);
+        close(fd);
+        return;
+    }
+    for (struct dirent *entry; (entry = readdir(dir)) != NULL; ) {
+        tree_visit(walker, dirfd(dir), path, entry->d_name);
+    }
+    closedir(dir);
+#endif
+}
+
+// Walker threads take directories from the shared stack until it is empty
+// and no other walker is still reading one that might add more
+static void *tree_walker_main(void *arg) {
+    tree_walker *walker = arg;
+    tree_walk *walk = walker->walk;
+    pthread_mutex_lock(&walk->lock);
+    for (;;) {
+        while (walk->dir_count == 0 && walk->active > 0) {
+            pthread_cond_wait(&walk->wake, &walk->lock);
+        }
+        if (walk->dir_count == 0) {
+            break;
+        }
+        char *path = walk->dirs[--walk->dir_count];
+        walk->active++;
+        pthread_mutex_unlock(&walk->lock);
         
-        free(result_chunk);
+        tree_read_dir(walker, path);
+        free(path);
         
-        if (show_progress && bytes_processed % (CHUNK_SIZE * 16) == 0) {  // Every 1MB
-            snprintf(progress_msg, sizeof(progress_msg), "processed %zu bytes", bytes_processed);
-            progress(progress_msg);
+        pthread_mutex_lock(&walk->lock);
+        walk->active--;
+        if (walk->dir_count == 0 && walk->active == 0) {
+            pthread_cond_broadcast(&walk->wake);
+        }
+    }
+    pthread_mutex_unlock(&walk->lock);
+    return NULL;
+}
+
+static int compare_tree_files(const void *a, const void *b) {
+    return strcmp(((const tree_file *)a)->path, ((const tree_file *)b)->path);
+}
+
+static char *join_path(const char *dir, const char *name) {
+    char *path = malloc(strlen(dir) + strlen(name) + 2);
+    if (path == NULL) {
+        die("memory allocation failed", EXIT_ERROR);
+    }
+    sprintf(path, "%s/%s", dir, name);
+    return path;
+}
+
+// xor -r SRC_DIR KEY OUT_DIR: XOR every regular file under SRC_DIR with
+// KEY into the same path under OUT_DIR, creating its directories. Walker
+// threads read directories in parallel; the files then run on the --batch
+// pool with KEY mapped once. Each output is as long as its input. With
+// restart every file uses KEY from its start; otherwise files take
+// consecutive ranges of KEY in byte order of their paths, so no two share
+// key bytes and the same command on OUT_DIR restores the tree.
+static void recursive_command(const char *src_dir, const char *key_operand, const char *out_dir,
+                              bool keyed, bool restart) {
+    char progress_msg[512];
+    tree_walk walk;
+    memset(&walk, 0, sizeof(walk));
+    struct stat src_st, out_st;
+    walk.src_fd = open(src_dir, O_RDONLY | O_DIRECTORY);
+    if (walk.src_fd < 0 || fstat(walk.src_fd, &src_st) != 0) {
+        snprintf(progress_msg, sizeof(progress_msg), "cannot open source directory %s: %s",
+                src_dir, strerror(errno));
+        die(progress_msg, EXIT_USAGE);
+    }
+    if (mkdir(out_dir, 0777) != 0 && errno != EEXIST) {
+        snprintf(progress_msg, sizeof(progress_msg), "cannot create output directory %s: %s",
+                out_dir, strerror(errno));
+        die(progress_msg, EXIT_ERROR);
+    }
+    walk.out_fd = open(out_dir, O_RDONLY | O_DIRECTORY);
+    if (walk.out_fd < 0 || fstat(walk.out_fd, &out_st) != 0) {
+        snprintf(progress_msg, sizeof(progress_msg), "cannot open output directory %s: %s",
+                out_dir, strerror(errno));
+        die(progress_msg, EXIT_USAGE);
+    }
+    if (src_st.st_dev == out_st.st_dev && src_st.st_ino == out_st.st_ino) {
+        die("cannot use the source directory as the output", EXIT_USAGE);
+    }
+    walk.out_dev = out_st.st_dev;
+    walk.out_ino = out_st.st_ino;
+    
+    batch_input key;
+    batch_open_input(&key, key_operand);
+    if (key.ok) {
+        batch_map_input(&key);
+    }
+    if (key.ok && keyed) {
+        batch_load_key(&key);
+    }
+    if (!key.ok) {
+        die(key.error, EXIT_USAGE);
+    }
+    
+    // Walk the tree
+    size_t walker_count = (size_t)jobs;
+    tree_walker *walkers = calloc(walker_count, sizeof(*walkers));
+    char *root = strdup("");
+    if (walkers == NULL || root == NULL) {
+        die("memory allocation failed", EXIT_ERROR);
+    }
+    pthread_mutex_init(&walk.lock, NULL);
+    pthread_cond_init(&walk.wake, NULL);
+    tree_push(&walk, root);
+    for (size_t w = 0; w < walker_count; w++) {
+        walkers[w].walk = &walk;
+        if (pthread_create(&walkers[w].thread, NULL, tree_walker_main, &walkers[w]) != 0) {
+            die("cannot start worker threads", EXIT_ERROR);
         }
     }
+    size_t count = 0;
+    for (size_t w = 0; w < walker_count; w++) {
+        pthread_join(walkers[w].thread, NULL);
+        count += walkers[w].count;
+    }
+    pthread_mutex_destroy(&walk.lock);
+    pthread_cond_destroy(&walk.wake);
+    free(walk.dirs);
+    close(walk.src_fd);
+    close(walk.out_fd);
     
-    // Handle trailing zeros
-    size_t output_size = total_size;
-    if (!preserve_zeros && total_size > 0) {
-        // Strip trailing zero bytes
-        while (output_size > 0 && all_data[output_size - 1] == 0) {
-            output_size--;
+    tree_file *files = malloc((count ? count : 1) * sizeof(*files));
+    if (files == NULL) {
+        die("memory allocation failed", EXIT_ERROR);
+    }
+    count = 0;
+    for (size_t w = 0; w < walker_count; w++) {
+        if (walkers[w].count > 0) {
+            memcpy(files + count, walkers[w].files, walkers[w].count * sizeof(*files));
+            count += walkers[w].count;
         }
+        free(walkers[w].files);
     }
+    free(walkers);
+    if (count > UINT32_MAX) {
+        die("too many files under the source directory", EXIT_USAGE);
+    }
+    qsort(files, count, sizeof(*files), compare_tree_files);
     
-    // Write output
-    if (output_size > 0) {
-        size_t written = fwrite(all_data, 1, output_size, stdout);
-        if (written != output_size) {
-            die("write error", EXIT_ERROR);
+    // Give each file its part of the key
+    batch_job batch;
+    memset(&batch, 0, sizeof(batch));
+    batch.keyed = keyed;
+    batch.mirror = true;
+    batch.count = count;
+    batch.entries = calloc(count ? count : 1, sizeof(*batch.entries));
+    if (batch.entries == NULL) {
+        die("memory allocation failed", EXIT_ERROR);
+    }
+    uint64_t key_needed = 0;
+    for (size_t i = 0; i < count; i++) {
+        batch_entry *entry = &batch.entries[i];
+        entry->operands[0] = join_path(src_dir, files[i].path);
+        entry->operands[1] = key_operand;
+        entry->operands[2] = join_path(out_dir, files[i].path);
+        entry->shared[1] = &key;
+        entry->range2.offset = restart ? 0 : key_needed;
+        entry->range2.length = files[i].size;
+        if (restart) {
+            key_needed = (files[i].size > key_needed) ? files[i].size : key_needed;
+        } else {
+            key_needed += files[i].size;
         }
-        fflush(stdout);
+        free(files[i].path);
+    }
+    free(files);
+    if (!keyed && key.size < key_needed) {
+        snprintf(progress_msg, sizeof(progress_msg),
+                "key is too short: the tree needs %" PRIu64 " bytes of it", key_needed);
+        die(progress_msg, EXIT_USAGE);
     }
     
-    // Progress message
-    const char *zero_msg = preserve_zeros ? "preserved" : "after stripping trailing zeros";
-    snprintf(progress_msg, sizeof(progress_msg), 
-            "XOR complete: %zu bytes processed, %zu bytes %s", 
-            bytes_processed, output_size, zero_msg);
-    progress(progress_msg);
+    run_batch(&batch);
+    for (size_t i = 0; i < count; i++) {
+        free((char *)batch.entries[i].operands[0]);
+        free((char *)batch.entries[i].operands[2]);
+    }
+    free(batch.entries);
+    batch_close_input(&key);
     
-    // Cleanup
-    free(all_data);
-    if (stream1 != stdin) fclose(stream1);
-    if (stream2 != stdin) fclose(stream2);
+    snprintf(progress_msg, sizeof(progress_msg), "tree complete: %zu files, %" PRIu64 " bytes",
+            count, batch.bytes_done);
+    progress(progress_msg);
+    if (walk.failures + batch.jobs_failed > 0) {
+        snprintf(progress_msg, sizeof(progress_msg), "%" PRIu64 " files or directories failed",
+                walk.failures + batch.jobs_failed);
+        die(progress_msg, EXIT_ERROR);
+    }
 }
 
 static void show_help(void) {
-    printf("usage: %s [-h] [-p] [-z] [--version] file file\n\n", PROG_NAME);
-    printf("XOR two files together, padding shorter with zeros\n\n");
+    printf("usage: %s [-h] [-p] [-z] [-i] [-o FILE] [-j N] [--kernel NAME] [--io ENGINE]\n", PROG_NAME);
+    printf("           [--splice] [--repeat-key] [--stats[=json]] [--version]\n");
+    printf("           file file [file ...]\n");
+    printf("       %s parity [-p] [-j N] [-m M] [--kernel NAME] PARITY DATA DATA [DATA ...]\n", PROG_NAME);
+    printf("       %s rebuild [-p] [-j N] [--kernel NAME] PARITY DATA DATA [DATA ...]\n", PROG_NAME);
+    printf("       %s --keygen SIZE [-p] [-o FILE] [-j N] [--kernel NAME] [--splice]\n", PROG_NAME);
+    printf("       %s --batch MANIFEST [-p] [-z] [-j N] [--repeat-key] [--kernel NAME]\n", PROG_NAME);
+    printf("       %s -r [-p] [-j N] [--repeat-key] [--key-offset MODE] SRC_DIR KEY OUT_DIR\n\n", PROG_NAME);
+    printf("XOR files together, padding shorter ones with zeros\n\n");
     printf("positional arguments:\n");
-    printf("  file file             Two input files to XOR (use '-' for stdin)\n\n");
+    printf("  file file [file ...]  Two or more input files to XOR (use '-' for stdin);\n");
+    printf("                        chacha20:SEEDFILE stands for the ChaCha20\n");
+    printf("                        keystream of SEEDFILE's 32-byte key and optional\n");
+    printf("                        12-byte nonce, as long as the other file;\n");
+    printf("                        file@OFFSET[:LENGTH] reads just that byte range\n");
+    printf("                        (K, M, G or T suffixes allowed)\n\n");
+    printf("commands:\n");
+    printf("  parity                Write PARITY, the XOR of the DATA files plus their\n");
+    printf("                        lengths (uses every CPU unless -j is given); with\n");
+    printf("                        -m M above 1, write Reed-Solomon parity PARITY.1\n");
+    printf("                        to PARITY.M instead, the first being the XOR\n");
+    printf("                        parity\n");
+    printf("  rebuild               Recreate DATA files that no longer exist, up to\n");
+    printf("                        one per parity file, at their original lengths,\n");
+    printf("                        then any missing PARITY.N\n\n");
     printf("options:\n");
     printf("  -h, --help            show this help message and exit\n");
     printf("  -p, --progress        Show progress information to stderr\n");
     printf("  -z, --preserve-zeros  Preserve trailing zero bytes in output (default: strip them)\n");
+    printf("  -m, --parity-files M  Number of parity files to write (parity only;\n");
+    printf("                        1 to 32, default 1)\n");
+    printf("  -o, --output FILE     Write to FILE instead of stdout\n");
+    printf("  -i, --in-place        XOR file2 into file1, rewriting file1 (not crash-safe)\n");
+    printf("  --repeat-key          Treat file2 as a key repeated across all of file1\n");
+    printf("                        instead of zero-padding it\n");
+    printf("  --keygen SIZE         Instead of XORing, write SIZE bytes (K, M, G or T\n");
+    printf("                        suffix allowed) of ChaCha20 keystream from a\n");
+    printf("                        random seed; -j splits it across threads when\n");
+    printf("                        the output is a regular file\n");
+    printf("  --batch MANIFEST      Run every 'INPUT1 INPUT2 OUTPUT' line of MANIFEST\n");
+    printf("                        as a job, on every CPU unless -j is given;\n");
+    printf("                        inputs named on several lines are mapped once\n");
+    printf("  -r, --recursive       XOR every regular file under SRC_DIR with KEY into\n");
+    printf("                        the same path under OUT_DIR, keeping its length\n");
+    printf("                        (uses every CPU unless -j is given)\n");
+    printf("  --key-offset MODE     With -r, continue (default: each file takes the\n");
+    printf("                        next unused part of KEY, in path order) or\n");
+    printf("                        restart (every file uses KEY from its start)\n");
+    printf("  -j, --jobs N          XOR with N threads (0: one per CPU) when both inputs\n");
+    printf("                        and the output are regular files (requires -o or -i;\n");
+    printf("                        two inputs only; not with --io or --splice)\n");
+    printf("  --kernel NAME         Force an XOR kernel: avx512, avx2, sse2 or scalar\n");
+    printf("                        (default: fastest supported by this CPU)\n");
+    printf("  --io ENGINE           I/O engine: mmap (default; maps regular files and\n");
+    printf("                        uses stdio for pipes and devices), stdio,\n");
+    printf("                        pipeline (reader, XOR and writer threads), or\n");
+    printf("                        uring (io_uring with several reads and writes in\n");
+    printf("                        flight; falls back to stdio if unsupported)\n");
+    printf("  --splice              When output is a pipe, hand it buffers with vmsplice\n");
+    printf("                        instead of copying them (unsafe if the reader\n");
+    printf("                        splices or tees the data onward)\n");
+    printf("  --stats[=json]        When done, print the run's byte counts, time spent\n");
+    printf("                        waiting on reads, XORing and waiting on writes,\n");
+    printf("                        kernel, engine and peak RSS as one line of JSON\n");
+    printf("                        to stderr\n");
     printf("  --version             show program's version number and exit\n\n");
     printf("Examples:\n");
     printf("  %s plaintext ciphertext > result.bin     # XOR two files\n", PROG_NAME);
     printf("  %s file1 - < file2 > result              # Use stdin for second file\n", PROG_NAME);
     printf("  cat file2 | %s file1 - > result          # Use stdin for second file\n", PROG_NAME);
-    printf("  %s -z file1 file2 > result.bin           # Preserve trailing zeros\n\n", PROG_NAME);
+    printf("  %s -z file1 file2 > result.bin           # Preserve trailing zeros\n", PROG_NAME);
+    printf("  %s -j 8 -o result.bin big1 big2          # XOR large files with 8 threads\n", PROG_NAME);
+    printf("  %s -i disk.img pad.bin                   # Encrypt disk.img in place\n", PROG_NAME);
+    printf("  %s --repeat-key data.bin key32 > out     # Cycle a 32-byte key over data\n", PROG_NAME);
+    printf("  %s data.bin chacha20:seed.bin > out      # Encrypt with no pad file\n", PROG_NAME);
+    printf("  %s shard1 shard2 shard3 > parity         # XOR any number of files\n", PROG_NAME);
+    printf("  %s --keygen 4G -j 0 -o key.bin           # 4GB random key on every CPU\n", PROG_NAME);
+    printf("  %s --batch jobs.txt                      # Many small XORs in one process\n", PROG_NAME);
+    printf("  %s -r photos/ pad.bin photos.enc/        # Encrypt a directory tree\n\n", PROG_NAME);
     printf("XOR Properties:\n");
     printf("  If result = A ⊕ B, then A = result ⊕ B and B = result ⊕ A\n");
     printf("  This means any two components can recover the third:\n");
@@ -241,20 +4162,147 @@ static void show_version(void) {
     printf("%s %s\n", PROG_NAME, VERSION);
 }
 
-static void validate_file_access(const char *filename, const char *description) {
+// XOR file2 into file1 where it lies. Only the part of file1 that file2
+// covers is read and rewritten; the rest is left alone apart from the
+// final truncation that strips trailing zeros.
+static void xor_in_place(const char *file1, const struct stat *st1,
+                         const char *file2, const struct stat *st2) {
+    char progress_msg[256];
+    byte_range range1;
+    char *path1 = operand_path(file1, &range1);
+    int fd = open(path1, O_RDWR);
+    if (fd < 0) {
+        snprintf(progress_msg, sizeof(progress_msg), "cannot open %s for writing: %s",
+                path1, strerror(errno));
+        die(progress_msg, EXIT_ERROR);
+    }
+    free(path1);
+    
+    // A range of file1 is rewritten where it lies and the rest of the file
+    // is left alone, so it is never truncated
+    bool ranged1 = is_ranged(&range1);
+    uint64_t base1 = range1.offset;
+    uint64_t size1 = ((uint64_t)st1->st_size > base1) ? (uint64_t)st1->st_size - base1 : 0;
+    if (size1 > range1.length) {
+        size1 = range1.length;
+    }
+    uint64_t covered;
+    uint64_t data_end;
+    
+    if (!ranged1 && (cyclic_key != NULL || (S_ISREG(st2->st_mode) && !operand_has_range(file2)))) {
+        snprintf(progress_msg, sizeof(progress_msg), "XORing %s into %s (%s kernel, %ld threads)",
+                file2, file1, xor_kernel_name(), jobs);
+        progress(progress_msg);
+        covered = (cyclic_key != NULL) ? size1 : (uint64_t)st2->st_size;
+        uint64_t bytes_read[2];
+        data_end = xor_parallel(file1, size1, file2, covered, fd, bytes_read);
+        stats.engine = "parallel";
+        stats.threads = jobs;
+        stats.input_bytes[0] = bytes_read[0];
+        if (cyclic_key == NULL) {
+            stats.input_bytes[1] = bytes_read[1];
+        }
+        if (covered < size1) {
+            covered = size1;  // xor_parallel() has already looked at the tail
+        }
+    } else {
+        snprintf(progress_msg, sizeof(progress_msg), "XORing %s into %s (%s kernel)",
+                strcmp(file2, "-") == 0 ? "stdin" : file2, file1, xor_kernel_name());
+        progress(progress_msg);
+        input_stream in2;
+        if (cyclic_key == NULL) {
+            open_input_stream(&in2, file2);
+        }
+        
+        uint64_t next_report = PROGRESS_INTERVAL;
+        covered = 0;
+        data_end = 0;
+        while (!interrupted) {
+            unsigned char chunk1[CHUNK_SIZE];
+            unsigned char chunk2[CHUNK_SIZE];
+            unsigned char result[CHUNK_SIZE];
+            const unsigned char *data2 = NULL;
+            size_t read2 = (cyclic_key != NULL)
+                ? span_in_file(size1, covered, CHUNK_SIZE)
+                : read_input(&in2, chunk2, span_in_file(range1.length, covered, CHUNK_SIZE), &data2);
+            if (read2 == 0) {
+                break;
+            }
+            
+            size_t read1 = span_in_file(size1, covered, read2);
+            pread_full(fd, chunk1, read1, base1 + covered);
+            stats.input_bytes[0] += read1;
+            uint64_t started = stats_clock();
+            size_t data_len = (cyclic_key != NULL)
+                ? xor_key_apply(cyclic_key, result, chunk1, read2, covered)
+                : xor_chunk(result, chunk1, read1, data2, read2);
+            stats_add(&stats.compute_ns, started);
+            pwrite_full(fd, result, read2, base1 + covered);
+            if (data_len > 0) {
+                data_end = covered + data_len;
+            }
+            covered += read2;
+            report_progress(covered, &next_report);
+        }
+        if (cyclic_key == NULL) {
+            if (input_error(&in2)) {
+                die("read error", EXIT_ERROR);
+            }
+            stats.input_bytes[1] = in2.consumed;
+            close_input_stream(&in2);
+        }
+        stats.engine = "in-place";
+        stats.threads = 1;
+    }
+    
+    uint64_t total = (size1 > covered) ? size1 : covered;
+    uint64_t out_size = total;
+    stats.bytes_processed = covered;
+    stats.bytes_written = covered;
+    if (ranged1) {
+        if (close(fd) != 0) {
+            die("write error", EXIT_ERROR);
+        }
+        snprintf(progress_msg, sizeof(progress_msg),
+                "XOR complete: %" PRIu64 " bytes rewritten at offset %" PRIu64, covered, base1);
+        progress(progress_msg);
+        return;
+    }
+    if (!preserve_zeros) {
+        // Past file2 the contents are unchanged, so only look for data there
+        uint64_t tail_end = find_data_end(fd, covered, size1);
+        out_size = (tail_end > covered) ? tail_end : data_end;
+    }
+    if (ftruncate(fd, (off_t)out_size) != 0) {
+        die("cannot truncate output file", EXIT_ERROR);
+    }
+    if (close(fd) != 0) {
+        die("write error", EXIT_ERROR);
+    }
+    stats.bytes_processed = total;
+    stats.bytes_written = out_size;
+    
+    const char *zero_msg = preserve_zeros ? "preserved" : "after stripping trailing zeros";
+    snprintf(progress_msg, sizeof(progress_msg),
+            "XOR complete: %" PRIu64 " bytes processed, %" PRIu64 " bytes %s",
+            total, out_size, zero_msg);
+    progress(progress_msg);
+}
+
+static void validate_file_access(const char *filename, const char *description, struct stat *st) {
+    memset(st, 0, sizeof(*st));
     if (strcmp(filename, "-") == 0) {
         return;  // stdin is always valid
     }
     
-    struct stat st;
-    if (stat(filename, &st) != 0) {
+    if (stat(filename, st) != 0) {
         char error_msg[256];
         snprintf(error_msg, sizeof(error_msg), "%s not found: %s", description, filename);
         die(error_msg, EXIT_USAGE);
     }
     
     // Allow regular files, FIFOs (named pipes), and character devices
-    if (!S_ISREG(st.st_mode) && !S_ISFIFO(st.st_mode) && !S_ISCHR(st.st_mode)) {
+    if (!S_ISREG(st->st_mode) && !S_ISFIFO(st->st_mode) && !S_ISCHR(st->st_mode)) {
         char error_msg[256];
         snprintf(error_msg, sizeof(error_msg), "%s is not a readable file: %s", description, filename);
         die(error_msg, EXIT_USAGE);
@@ -281,18 +4329,52 @@ static bool is_same_file(const char *file1, const char *file2) {
 }
 
 int main(int argc, char *argv[]) {
+    clock_gettime(CLOCK_MONOTONIC, &stats.start);
     setup_signal_handling();
     
+    // Subcommands come first; use ./parity for a file of that name
+    enum { CMD_XOR, CMD_PARITY, CMD_REBUILD } command = CMD_XOR;
+    if (argc > 1 && strcmp(argv[1], "parity") == 0) {
+        command = CMD_PARITY;
+    } else if (argc > 1 && strcmp(argv[1], "rebuild") == 0) {
+        command = CMD_REBUILD;
+    }
+    if (command != CMD_XOR) {
+        argc--;
+        argv++;
+    }
+    
     static struct option long_options[] = {
         {"help", no_argument, 0, 'h'},
         {"progress", no_argument, 0, 'p'},
         {"preserve-zeros", no_argument, 0, 'z'},
         {"version", no_argument, 0, 'V'},
+        {"kernel", required_argument, 0, 'K'},
+        {"io", required_argument, 0, 'I'},
+        {"output", required_argument, 0, 'o'},
+        {"jobs", required_argument, 0, 'j'},
+        {"splice", no_argument, 0, 'S'},
+        {"in-place", no_argument, 0, 'i'},
+        {"repeat-key", no_argument, 0, 'R'},
+        {"parity-files", required_argument, 0, 'm'},
+        {"keygen", required_argument, 0, 'G'},
+        {"batch", required_argument, 0, 'B'},
+        {"recursive", no_argument, 0, 'r'},
+        {"key-offset", required_argument, 0, 'O'},
+        {"stats", optional_argument, 0, 'T'},
         {0, 0, 0, 0}
     };
     
+    const char *kernel_name = NULL;
+    bool repeat_key = false;
+    bool jobs_given = false;
+    size_t parity_count = 0;
+    const char *keygen_size = NULL;
+    const char *manifest = NULL;
+    bool recursive = false;
+    const char *key_offset = NULL;
     int c;
-    while ((c = getopt_long(argc, argv, "hpz", long_options, NULL)) != -1) {
+    while ((c = getopt_long(argc, argv, "hpziro:j:m:", long_options, NULL)) != -1) {
         switch (c) {
             case 'h':
                 show_help();
@@ -304,6 +4386,51 @@ int main(int argc, char *argv[]) {
             case 'z':
                 preserve_zeros = true;
                 break;
+            case 'K':
+                kernel_name = optarg;
+                break;
+            case 'I':
+                io_mode = parse_io_engine(optarg);
+                break;
+            case 'o':
+                output_file = optarg;
+                break;
+            case 'j':
+                jobs = parse_jobs(optarg);
+                jobs_given = true;
+                break;
+            case 'S':
+                use_splice = true;
+                break;
+            case 'i':
+                in_place = true;
+                break;
+            case 'R':
+                repeat_key = true;
+                break;
+            case 'm':
+                parity_count = parse_parity_count(optarg);
+                break;
+            case 'G':
+                keygen_size = optarg;
+                break;
+            case 'B':
+                manifest = optarg;
+                break;
+            case 'r':
+                recursive = true;
+                break;
+            case 'O':
+                key_offset = optarg;
+                break;
+            case 'T':
+                if (optarg != NULL && strcmp(optarg, "json") != 0) {
+                    char error_msg[256];
+                    snprintf(error_msg, sizeof(error_msg), "unknown stats format: %s", optarg);
+                    die(error_msg, EXIT_USAGE);
+                }
+                collect_stats = true;
+                break;
             case 'V':
                 show_version();
                 exit(EXIT_SUCCESS);
@@ -317,36 +4444,244 @@ int main(int argc, char *argv[]) {
         }
     }
     
+    if (collect_stats && (command != CMD_XOR || keygen_size != NULL || manifest != NULL || recursive)) {
+        die("--stats is only for XORing files", EXIT_USAGE);
+    }
+    
+    if (command != CMD_XOR) {
+        if (output_file != NULL || in_place || repeat_key || preserve_zeros || use_splice ||
+            keygen_size != NULL || manifest != NULL || recursive || key_offset != NULL) {
+            die("parity and rebuild take only -p, -j, -m and --kernel", EXIT_USAGE);
+        }
+        if (command == CMD_REBUILD && parity_count != 0) {
+            die("rebuild reads the parity count from the parity files", EXIT_USAGE);
+        }
+        if (argc - optind < 2) {
+            die("requires a parity file and the data files", EXIT_USAGE);
+        }
+        select_kernel(kernel_name);
+        
+        // Stripes are independent, so use every CPU unless told otherwise
+        if (!jobs_given) {
+            jobs = parse_jobs("0");
+        }
+        const char *const *data_files = (const char *const *)(argv + optind + 1);
+        size_t count = (size_t)(argc - optind - 1);
+        if (command == CMD_PARITY) {
+            parity_command(argv[optind], data_files, count, parity_count ? parity_count : 1);
+        } else {
+            rebuild_command(argv[optind], data_files, count);
+        }
+        return EXIT_SUCCESS;
+    }
+    if (parity_count != 0) {
+        die("-m is only for the parity command", EXIT_USAGE);
+    }
+    
+    if (key_offset != NULL && !recursive) {
+        die("--key-offset is only for -r", EXIT_USAGE);
+    }
+    if (recursive) {
+        if (argc - optind != 3) {
+            die("-r takes SRC_DIR KEY OUT_DIR", EXIT_USAGE);
+        }
+        if (output_file != NULL || in_place || use_splice || io_mode != IO_MMAP ||
+            keygen_size != NULL || manifest != NULL) {
+            die("-r takes only -p, -j, --repeat-key, --key-offset and --kernel", EXIT_USAGE);
+        }
+        bool restart = false;
+        if (key_offset != NULL && strcmp(key_offset, "restart") == 0) {
+            restart = true;
+        } else if (key_offset != NULL && strcmp(key_offset, "continue") != 0) {
+            die("--key-offset must be continue or restart", EXIT_USAGE);
+        }
+        select_kernel(kernel_name);
+        if (!jobs_given) {
+            jobs = parse_jobs("0");
+        }
+        recursive_command(argv[optind], argv[optind + 1], argv[optind + 2], repeat_key, restart);
+        return EXIT_SUCCESS;
+    }
+    
+    if (manifest != NULL) {
+        if (argc > optind) {
+            die("--batch takes its files from the manifest", EXIT_USAGE);
+        }
+        if (output_file != NULL || in_place || use_splice || io_mode != IO_MMAP ||
+            keygen_size != NULL) {
+            die("--batch takes only -p, -z, -j, --repeat-key and --kernel", EXIT_USAGE);
+        }
+        select_kernel(kernel_name);
+        
+        // Jobs are independent, so use every CPU unless told otherwise
+        if (!jobs_given) {
+            jobs = parse_jobs("0");
+        }
+        batch_command(manifest, repeat_key);
+        return EXIT_SUCCESS;
+    }
+    
+    if (keygen_size != NULL) {
+        if (argc > optind) {
+            die("--keygen takes no input files", EXIT_USAGE);
+        }
+        if (in_place || repeat_key) {
+            die("--keygen cannot be combined with --in-place or --repeat-key", EXIT_USAGE);
+        }
+        uint64_t size = parse_size(keygen_size);
+        select_kernel(kernel_name);
+        keygen_command(size);
+        return EXIT_SUCCESS;
+    }
+    
     // Check for required positional arguments
-    if (argc - optind != 2) {
-        fprintf(stderr, "%s: error: requires exactly two file arguments\n", PROG_NAME);
+    if (argc - optind < 2) {
+        fprintf(stderr, "%s: error: requires at least two file arguments\n", PROG_NAME);
         fprintf(stderr, "Try '%s --help' for more information.\n", PROG_NAME);
         exit(EXIT_USAGE);
     }
+    size_t count = (size_t)(argc - optind);
+    if (count > MAX_INPUTS) {
+        die("too many input files", EXIT_USAGE);
+    }
+    if (count > 2 && (in_place || repeat_key)) {
+        die("--in-place and --repeat-key take exactly two files", EXIT_USAGE);
+    }
+    if (count > 2 && jobs != 1) {
+        die("--jobs supports only two input files", EXIT_USAGE);
+    }
+    
+    select_kernel(kernel_name);
     
-    const char *file1 = argv[optind];
-    const char *file2 = argv[optind + 1];
+    // A chacha20:SEEDFILE operand is a key like --repeat-key's, so it
+    // goes second
+    bool stream_key = false;
+    for (int k = argc - 1; k >= optind; k--) {
+        if (strncmp(argv[k], "chacha20:", 9) == 0) {
+            if (count != 2 || stream_key || repeat_key) {
+                die("a chacha20: operand takes exactly one other file and no --repeat-key", EXIT_USAGE);
+            }
+            if (k == optind && in_place) {
+                die("--in-place requires file1 to be a regular file", EXIT_USAGE);
+            }
+            char *key_operand = argv[k];
+            argv[k] = argv[optind + 1];
+            argv[optind + 1] = key_operand;
+            stream_key = true;
+        }
+    }
     
-    // Validate arguments
-    validate_file_access(file1, "first input file");
-    validate_file_access(file2, "second input file");
+    const char *const *files = (const char *const *)(argv + optind);
+    const char *file1 = files[0];
+    const char *file2 = files[1];
+    stats.names = files;
+    stats.input_count = count;
+    
+    // Validate arguments; the stat results give the sizes up front. Checks
+    // on the files themselves look past any @OFFSET:LENGTH range.
+    struct stat *sts = calloc(count, sizeof(*sts));
+    char **paths = calloc(count, sizeof(*paths));
+    byte_range *ranges = calloc(count, sizeof(*ranges));
+    if (sts == NULL || paths == NULL || ranges == NULL) {
+        die("memory allocation failed", EXIT_ERROR);
+    }
+    for (size_t k = 0; k < count; k++) {
+        paths[k] = operand_path(files[k], &ranges[k]);
+    }
+    for (size_t k = 0; k < count; k++) {
+        char description[64];
+        if (k < 2) {
+            snprintf(description, sizeof(description), "%s input file", k == 0 ? "first" : "second");
+        } else {
+            snprintf(description, sizeof(description), "input file %zu", k + 1);
+        }
+        if (k == 1 && stream_key) {
+            validate_file_access(files[k] + 9, "seed file", &sts[k]);
+        } else {
+            validate_file_access(paths[k], description, &sts[k]);
+        }
+    }
     
     // Check for stdin conflicts
     int stdin_count = 0;
-    if (strcmp(file1, "-") == 0) stdin_count++;
-    if (strcmp(file2, "-") == 0) stdin_count++;
+    for (size_t k = 0; k < count; k++) {
+        if (strcmp(paths[k], "-") == 0) stdin_count++;
+    }
     
     if (stdin_count > 1) {
         die("cannot read multiple files from stdin", EXIT_USAGE);
     }
     
-    // Check for same file
-    if (is_same_file(file1, file2)) {
-        die("cannot use the same file for both inputs", EXIT_USAGE);
+    // Check for same file; two ranges of one file are fine
+    for (size_t k = 0; k < count; k++) {
+        for (size_t j = k + 1; j < count; j++) {
+            if ((!is_ranged(&ranges[k]) || !is_ranged(&ranges[j])) && is_same_file(paths[k], paths[j])) {
+                die(count == 2 ? "cannot use the same file for both inputs"
+                               : "cannot use the same file for two inputs", EXIT_USAGE);
+            }
+        }
+    }
+    
+    // Opening the output truncates it, so it must not be an input
+    if (output_file != NULL && strcmp(output_file, "-") == 0) {
+        output_file = NULL;
+    }
+    for (size_t k = 0; output_file != NULL && k < count; k++) {
+        if (is_same_file(paths[k], output_file)) {
+            die("cannot use an input file as the output", EXIT_USAGE);
+        }
+    }
+    struct stat st1 = sts[0];
+    if (in_place) {
+        if (output_file != NULL) {
+            die("--in-place cannot be combined with --output", EXIT_USAGE);
+        }
+        if (!S_ISREG(st1.st_mode)) {
+            die("--in-place requires file1 to be a regular file", EXIT_USAGE);
+        }
+        
+        // is_same_file() cannot see through stdin
+        struct stat stdin_st;
+        if (strcmp(paths[1], "-") == 0 && fstat(STDIN_FILENO, &stdin_st) == 0 &&
+            stdin_st.st_dev == st1.st_dev && stdin_st.st_ino == st1.st_ino) {
+            die("cannot use the same file for both inputs", EXIT_USAGE);
+        }
+        
+        // Another range of file1 may only be read ahead of the range being
+        // rewritten, and must not reach into it
+        for (size_t k = 1; k < count; k++) {
+            if (is_same_file(paths[0], paths[k]) &&
+                ranges_clash(&ranges[0], &ranges[k], (uint64_t)st1.st_size)) {
+                die("--in-place cannot read file1 where it is being rewritten", EXIT_USAGE);
+            }
+        }
+    } else if (jobs != 1 && output_file == NULL) {
+        die("--jobs requires --output or --in-place", EXIT_USAGE);
+    }
+    if (jobs != 1 && (io_mode != IO_MMAP || use_splice)) {
+        die("--jobs cannot be combined with --io or --splice", EXIT_USAGE);
+    }
+    
+    // The key is read up front, so it may come from stdin even in place
+    if (repeat_key) {
+        load_repeat_key(file2);
+    } else if (stream_key) {
+        load_stream_key(file2 + 9);
     }
     
     // XOR the files
-    xor_files(file1, file2);
+    if (in_place) {
+        xor_in_place(file1, &sts[0], file2, &sts[1]);
+    } else {
+        xor_files(files, sts, count);
+    }
+    report_stats();
     
+    for (size_t k = 0; k < count; k++) {
+        free(paths[k]);
+    }
+    free(paths);
+    free(ranges);
+    free(sts);
     return EXIT_SUCCESS;
 }
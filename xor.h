@@ -0,0 +1,112 @@
+/*
+ * libxor - the XOR engine behind the xor tool
+ *
+ * SIMD XOR, GF(2^8) and ChaCha20 kernels picked at runtime from CPUID,
+ * repeating and keystream keys, and a streaming context, for programs
+ * that want xor's speed in process rather than by running the command.
+ * Functions that can fail return XOR_OK or a negative XOR_ERR_* code and
+ * never exit; the few preconditions documented below are asserted.
+ * Everything is thread-safe once the kernel has been chosen.
+ */
+
+#ifndef XOR_H
+#define XOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Status codes
+#define XOR_OK 0
+#define XOR_ERR_ARGUMENT (-1)        // NULL where data is needed, or a bad length
+#define XOR_ERR_NO_MEMORY (-2)
+#define XOR_ERR_UNKNOWN_KERNEL (-3)
+#define XOR_ERR_UNSUPPORTED (-4)     // The kernel needs instructions this CPU lacks
+
+#define XOR_KEY_MAX (64 * 1024 * 1024)  // Longest repeating key
+#define XOR_KEYSTREAM_KEY 32            // ChaCha20 key bytes in a seed
+#define XOR_KEYSTREAM_SEED 44           // Key plus the longest nonce
+
+// A message for a status code
+const char *xor_strerror(int status);
+
+// Use the named kernel (avx512, avx2, sse2 or scalar), or with NULL the
+// widest this CPU supports, which is also what is used until this is
+// called. The GF(2^8) and ChaCha20 kernels follow it to the same width.
+// Call it before any other thread uses the library.
+int xor_use_kernel(const char *name);
+const char *xor_kernel_name(void);
+const char *xor_gf_kernel_name(void);
+const char *xor_keystream_kernel_name(void);
+
+// dst = a ^ b for n bytes. dst may alias either input. Like every XOR
+// below, returns the length of dst up to its last nonzero byte, 0 if it
+// is all zeros, so trailing zeros can be stripped without a second pass.
+size_t xor_buffers(void *dst, const void *a, const void *b, size_t n);
+
+// dst = the XOR of count >= 1 buffers of n bytes, in one pass
+size_t xor_buffers_multi(void *dst, const unsigned char *const *src, size_t count, size_t n);
+
+// The length of buf up to its last nonzero byte
+size_t xor_data_length(const void *buf, size_t n);
+
+// GF(2^8) arithmetic modulo x^8 + x^4 + x^3 + x^2 + 1 (0x11d). Division
+// by zero is undefined, so b must be nonzero; it is asserted, not reported.
+unsigned char xor_gf_mul(unsigned char a, unsigned char b);
+unsigned char xor_gf_div(unsigned char a, unsigned char b);
+
+// dst ^= c * src for n bytes, with tables from xor_gf_tables(c, tables)
+void xor_gf_tables(unsigned char c, unsigned char tables[32]);
+void xor_gf_mul_add(void *dst, const void *src, const unsigned char tables[32], size_t n);
+
+// A ChaCha20 keystream (RFC 7539), as the block function's initial state
+typedef struct {
+    uint32_t state[16];
+} xor_keystream;
+
+// Seed a keystream with a 32-byte key and up to 12 bytes of nonce;
+// missing nonce bytes are zero. The block counter starts at 0.
+int xor_keystream_init(xor_keystream *ks, const void *seed, size_t len);
+
+// The len keystream bytes starting at offset
+void xor_keystream_fill(const xor_keystream *ks, uint64_t offset, void *out, size_t len);
+
+// A key applied across data: 1 to XOR_KEY_MAX bytes repeated for as long
+// as the data, or a ChaCha20 keystream generated as it is used
+typedef struct xor_key xor_key;
+
+int xor_key_new(xor_key **key, const void *bytes, size_t len);
+int xor_key_new_keystream(xor_key **key, const void *seed, size_t len);
+void xor_key_free(xor_key *key);
+
+// The repeating key's length, or 0 for a keystream
+size_t xor_key_length(const xor_key *key);
+
+// Nonzero if the key is applied from SIMD registers, for lengths that
+// divide 64
+int xor_key_in_registers(const xor_key *key);
+
+// dst = src ^ the key bytes for offsets [offset, offset + n) of the data.
+// dst must not overlap src.
+size_t xor_key_apply(const xor_key *key, void *dst, const void *src, size_t n, uint64_t offset);
+
+// Streaming XOR of data as it arrives. With a key, each update XORs a
+// with the key at the stream's offset; without one, it XORs a with b, and
+// either may be NULL for a run of zeros, as the command pads the shorter
+// file. tell reports the bytes processed so far and where the last nonzero
+// output byte ended; finish reports the same, then frees the stream.
+typedef struct xor_stream xor_stream;
+
+int xor_stream_init(xor_stream **stream, const xor_key *key);
+int xor_stream_update(xor_stream *stream, void *out, const void *a, const void *b, size_t n);
+int xor_stream_tell(const xor_stream *stream, uint64_t *length, uint64_t *data_end);
+int xor_stream_finish(xor_stream *stream, uint64_t *length, uint64_t *data_end);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif